@@ -0,0 +1,636 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+#include <yaml-cpp/yaml.h>
+
+#include "throw-with-trace.hpp"
+#include "worker-pool.hpp"
+
+
+// Aggregates the stats of different runs of the same workloads, like scripts/aggdata.py, but streaming.
+// The files are parsed in parallel, and each one is reduced to a mean and variance per group and column
+// as soon as it is read. These partial results are merged in order, so the memory used depends on the
+// size of a single run and not on the number of runs or workloads.
+
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+using fmt::literals::operator""_format;
+
+
+// Mean and variance of the values of a column, they can be merged (Chan et al.).
+// NaN values are ignored, like pandas does.
+struct Accum
+{
+	uint64_t n = 0;
+	double mean = 0;
+	double m2 = 0;
+
+	void add(double x)
+	{
+		if (std::isnan(x))
+			return;
+		n++;
+		double delta = x - mean;
+		mean += delta / n;
+		m2 += delta * (x - mean);
+	}
+
+	// Add 'count' times the value 'x'
+	void add(double x, uint64_t count)
+	{
+		if (std::isnan(x) || !count)
+			return;
+		Accum other;
+		other.n = count;
+		other.mean = x;
+		merge(other);
+	}
+
+	void merge(const Accum &o)
+	{
+		if (!o.n)
+			return;
+		uint64_t n_ab = n + o.n;
+		double delta = o.mean - mean;
+		mean += delta * o.n / n_ab;
+		m2 += o.m2 + delta * delta * n * o.n / n_ab;
+		n = n_ab;
+	}
+
+	double get_mean() const { return n ? mean : NAN; }
+	double get_std() const { return n > 1 ? std::sqrt(m2 / (n - 1)) : NAN; } // Sample standard deviation
+};
+
+
+// Rows are grouped by app, and also by interval for the interval files
+struct GroupKey
+{
+	double interval;
+	string app;
+
+	bool operator<(const GroupKey &o) const
+	{
+		return interval < o.interval || (interval == o.interval && app < o.app);
+	}
+};
+
+
+struct Group
+{
+	vector<Accum> acc; // One per column
+	uint64_t rows = 0;
+};
+
+
+// Columns computed for every file, after the ones read
+static const vector<string> computed_columns = {"progress", "slowdown", "stp", "antt", "unfairness"};
+
+
+// Partial aggregation of a single file
+struct FileData
+{
+	string path;
+	string error;           // Not empty if the file could not be read
+	vector<string> columns; // Read columns, without the index, followed by the computed ones
+	vector<bool> numeric;   // Columns with only numbers, the others are discarded
+	std::map<GroupKey, Group> groups;
+};
+
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+	const char *data = nullptr;
+	size_t length = 0;
+
+	public:
+
+	MappedFile(const string &path)
+	{
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			throw_with_trace(std::runtime_error("Could not open '{}': {}"_format(path, strerror(errno))));
+		struct stat st;
+		if (fstat(fd, &st) < 0)
+		{
+			close(fd);
+			throw_with_trace(std::runtime_error("Could not stat '{}': {}"_format(path, strerror(errno))));
+		}
+		length = st.st_size;
+		if (length)
+		{
+			void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED)
+			{
+				close(fd);
+				throw_with_trace(std::runtime_error("Could not map '{}': {}"_format(path, strerror(errno))));
+			}
+			madvise(p, length, MADV_SEQUENTIAL);
+			data = (const char *) p;
+		}
+		close(fd);
+	}
+
+	~MappedFile()
+	{
+		if (data)
+			munmap((void *) data, length);
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char *begin() const { return data; }
+	const char *end() const { return data + length; }
+};
+
+
+// Split a line of a CSV without quotes
+static
+void split_line(const char *begin, const char *end, vector<std::pair<const char *, const char *>> &fields)
+{
+	fields.clear();
+	const char *start = begin;
+	for (const char *p = begin; p != end; p++)
+	{
+		if (*p == ',')
+		{
+			fields.emplace_back(start, p);
+			start = p + 1;
+		}
+	}
+	fields.emplace_back(start, end);
+}
+
+
+// Parses a number like pandas does: empty fields are NaN, and anything that is not a decimal number
+// (i.e. the hexadecimal masks) makes the column non numeric
+static
+bool parse_number(const char *begin, const char *end, double &value)
+{
+	size_t len = end - begin;
+	if (!len)
+	{
+		value = NAN;
+		return true;
+	}
+
+	char buf[64];
+	if (len >= sizeof(buf) || std::find_if(begin, end, [](char c) { return c == 'x' || c == 'X'; }) != end)
+		return false;
+	memcpy(buf, begin, len);
+	buf[len] = '\0';
+
+	char *endptr;
+	value = strtod(buf, &endptr);
+	return endptr == buf + len;
+}
+
+
+// Pandas writes infinite values as NaN
+static
+double finite_or_nan(double x)
+{
+	return std::isinf(x) ? NAN : x;
+}
+
+
+static
+void read_file(FileData &fd, bool by_interval, double alone)
+{
+	MappedFile file(fd.path);
+	const char *p = file.begin();
+	const char *end = file.end();
+	if (p == end)
+		throw_with_trace(std::runtime_error("empty file"));
+
+	// Header
+	vector<std::pair<const char *, const char *>> fields;
+	const char *eol = std::find(p, end, '\n');
+	split_line(p, eol, fields);
+	p = eol == end ? end : eol + 1;
+
+	const size_t none = -1;
+	size_t interval_pos = none;
+	size_t app_pos = none;
+	vector<size_t> column_of_field(fields.size(), none);
+	for (size_t i = 0; i < fields.size(); i++)
+	{
+		string name(fields[i].first, fields[i].second);
+		if (name == "interval")
+			interval_pos = i;
+		if (name == "app")
+		{
+			app_pos = i;
+			continue;
+		}
+		if (by_interval && name == "interval")
+			continue;
+		column_of_field[i] = fd.columns.size();
+		fd.columns.push_back(name);
+	}
+	if (interval_pos == none || app_pos == none)
+		throw_with_trace(std::runtime_error("there are no 'interval' and 'app' columns"));
+
+	const size_t progress = fd.columns.size();
+	const size_t slowdown = progress + 1;
+	const size_t stp = progress + 2;
+	const size_t antt = progress + 3;
+	const size_t unfairness = progress + 4;
+	fd.columns.insert(fd.columns.end(), computed_columns.begin(), computed_columns.end());
+	fd.numeric.assign(fd.columns.size(), true);
+
+	// Sums of the whole file, for the computed columns
+	double stp_sum = 0;
+	Accum slowdown_acc;
+	Accum progress_acc;
+
+	vector<double> values(fd.columns.size());
+	for (; p < end; p = eol == end ? end : eol + 1)
+	{
+		eol = std::find(p, end, '\n');
+		if (eol == p)
+			continue;
+		split_line(p, eol, fields);
+		if (fields.size() > column_of_field.size())
+			throw_with_trace(std::runtime_error("a line has more fields than the header"));
+
+		std::fill(values.begin(), values.end(), NAN);
+		for (size_t i = 0; i < fields.size(); i++)
+		{
+			size_t col = column_of_field[i];
+			if (col == none)
+				continue;
+			if (!parse_number(fields[i].first, fields[i].second, values[col]))
+			{
+				fd.numeric[col] = false;
+				values[col] = NAN;
+			}
+		}
+
+		double interval;
+		if (interval_pos >= fields.size() || !parse_number(fields[interval_pos].first, fields[interval_pos].second, interval))
+			interval = NAN;
+		values[progress] = alone / interval;
+		values[slowdown] = interval / alone;
+		if (!std::isnan(values[progress]))
+			stp_sum += values[progress];
+		slowdown_acc.add(values[slowdown]);
+
+		// Rows without progress are discarded, but they still count for the stp and antt
+		for (auto &v : values)
+			v = finite_or_nan(v);
+		if (std::isnan(values[progress]))
+			continue;
+		progress_acc.add(values[progress]);
+
+		GroupKey key;
+		key.interval = by_interval ? interval : 0;
+		if (app_pos < fields.size())
+			key.app = string(fields[app_pos].first, fields[app_pos].second);
+		auto &group = fd.groups[key];
+		if (group.acc.empty())
+			group.acc.resize(fd.columns.size());
+		for (size_t i = 0; i < values.size(); i++)
+			group.acc[i].add(values[i]);
+		group.rows++;
+	}
+
+	// The columns computed from the whole file have the same value in all the rows
+	double file_stp = finite_or_nan(stp_sum);
+	double file_antt = finite_or_nan(slowdown_acc.get_mean());
+	double file_unfairness = finite_or_nan(progress_acc.get_std() / progress_acc.get_mean());
+	for (auto &kv : fd.groups)
+	{
+		auto &group = kv.second;
+		group.acc[stp].add(file_stp, group.rows);
+		group.acc[antt].add(file_antt, group.rows);
+		group.acc[unfairness].add(file_unfairness, group.rows);
+	}
+}
+
+
+// Aggregation of all the runs of a workload
+class Table
+{
+	bool by_interval;
+	vector<string> columns;
+	std::map<string, size_t> column_pos;
+	vector<bool> numeric;
+	std::map<GroupKey, vector<Accum>> groups;
+
+	size_t column(const string &name)
+	{
+		auto it = column_pos.find(name);
+		if (it != column_pos.end())
+			return it->second;
+		column_pos[name] = columns.size();
+		columns.push_back(name);
+		numeric.push_back(true);
+		for (auto &kv : groups)
+			kv.second.resize(columns.size());
+		return columns.size() - 1;
+	}
+
+	static string key_to_string(double x)
+	{
+		if (std::isnan(x))
+			return "";
+		if (x == std::trunc(x) && std::fabs(x) < 1e15)
+			return "{}"_format((int64_t) x);
+		return "{}"_format(x);
+	}
+
+	static string value_to_string(double x)
+	{
+		return std::isnan(x) ? "" : "{}"_format(x);
+	}
+
+	void write_header(std::ostream &out) const
+	{
+		out << (by_interval ? "interval,app" : "app");
+		for (size_t i = 0; i < columns.size(); i++)
+			if (numeric[i])
+				out << "," << columns[i] << ":mean," << columns[i] << ":std";
+		out << "\n";
+	}
+
+	void write_row(std::ostream &out, const GroupKey &key, const vector<Accum> &acc) const
+	{
+		if (by_interval)
+			out << key_to_string(key.interval) << ",";
+		out << key.app;
+		for (size_t i = 0; i < columns.size(); i++)
+			if (numeric[i])
+				out << "," << value_to_string(acc[i].get_mean()) << "," << value_to_string(acc[i].get_std());
+		out << "\n";
+	}
+
+	public:
+
+	Table(bool _by_interval) : by_interval(_by_interval) {}
+
+	bool empty() const { return groups.empty(); }
+
+	void merge(const FileData &fd)
+	{
+		vector<size_t> pos;
+		for (size_t i = 0; i < fd.columns.size(); i++)
+		{
+			pos.push_back(column(fd.columns[i]));
+			if (!fd.numeric[i])
+				numeric[pos.back()] = false;
+		}
+
+		for (const auto &kv : fd.groups)
+		{
+			auto &acc = groups[kv.first];
+			acc.resize(columns.size());
+			for (size_t i = 0; i < pos.size(); i++)
+				acc[pos[i]].merge(kv.second.acc[i]);
+		}
+	}
+
+	void write(std::ostream &out) const
+	{
+		write_header(out);
+		for (const auto &kv : groups)
+			write_row(out, kv.first, kv.second);
+	}
+
+	vector<string> apps() const
+	{
+		vector<string> result;
+		for (const auto &kv : groups)
+			result.push_back(kv.first.app);
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+		return result;
+	}
+
+	void write_app(std::ostream &out, const string &app) const
+	{
+		write_header(out);
+		for (const auto &kv : groups)
+			if (kv.first.app == app)
+				write_row(out, kv.first, kv.second);
+	}
+};
+
+
+// Files of the runs of a workload whose name matches the pattern
+static
+vector<string> find_files(const string &input_dir, const string &pattern)
+{
+	const std::regex re(pattern);
+	vector<string> files;
+	for (const auto &entry : fs::directory_iterator(input_dir))
+	{
+		string name = entry.path().filename().string();
+		if (std::regex_match(name, re))
+			files.push_back(entry.path().string());
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+
+// Parse the files in batches as wide as the pool, merging the results in order
+static
+Table read_and_merge(WorkerPool &pool, const vector<string> &files, bool by_interval, double alone)
+{
+	Table table(by_interval);
+	for (size_t first = 0; first < files.size(); first += pool.width())
+	{
+		size_t n = std::min(pool.width(), files.size() - first);
+		vector<FileData> batch(n);
+		pool.run(n, [&](size_t i)
+		{
+			batch[i].path = files[first + i];
+			try
+			{
+				read_file(batch[i], by_interval, alone);
+			}
+			catch (const std::exception &e)
+			{
+				batch[i].error = e.what();
+			}
+		});
+
+		for (auto &fd : batch)
+		{
+			if (!fd.error.empty())
+			{
+				cout << "Warning: could not read '{}': {}"_format(fd.path, fd.error) << endl;
+				continue;
+			}
+			table.merge(fd);
+			fd = FileData(); // Free it as soon as possible
+		}
+	}
+
+	if (table.empty())
+		throw_with_trace(std::runtime_error("No files could be read for the workload"));
+	return table;
+}
+
+
+static
+void process_intdata(WorkerPool &pool, const vector<string> &workload, const string &input_dir, const string &output_dir, double alone)
+{
+	// There is one file for each run of the workload
+	string wl_name = boost::algorithm::join(workload, "-");
+	auto files = find_files(input_dir, "{}_[0-9]+.csv"_format(wl_name));
+	if (files.empty())
+	{
+		cout << "The workload {} has no 'int' files"_format(wl_name) << endl;
+		return;
+	}
+
+	Table table = read_and_merge(pool, files, true, alone);
+
+	// Store csv
+	{
+		std::ofstream out("{}/{}.csv"_format(output_dir, wl_name));
+		table.write(out);
+	}
+
+	// Store a csv per app
+	fs::create_directories("{}/{}"_format(output_dir, wl_name));
+	for (const auto &app : table.apps())
+	{
+		string filename = "{}/{}/{}.csv"_format(output_dir, wl_name, app);
+		if (workload.size() > 1)
+		{
+			std::ofstream out(filename);
+			table.write_app(out, app);
+		}
+		// If there is only one app this file will be equal to the one for the workload, so just link them
+		else
+		{
+			fs::create_symlink("../{}.csv"_format(wl_name), filename);
+		}
+	}
+}
+
+
+static
+void process_data(WorkerPool &pool, const vector<string> &workload, const string &input_dir, const string &output_dir, double alone)
+{
+	string wl_name = boost::algorithm::join(workload, "-");
+	for (const string kind : {"fin", "tot"})
+	{
+		// There is one file for each run of the workload
+		auto files = find_files(input_dir, "{}_[0-9]+_{}.csv"_format(wl_name, kind));
+		if (files.empty())
+		{
+			cout << "The workload {} has no '{}' files"_format(wl_name, kind) << endl;
+			continue;
+		}
+
+		Table table = read_and_merge(pool, files, false, alone);
+		std::ofstream out("{}/{}_{}.csv"_format(output_dir, wl_name, kind));
+		table.write(out);
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	po::options_description desc("Aggregates stats for different runs of the same workload");
+	desc.add_options()
+		("help,h", "print usage message")
+		("workloads,w", po::value<string>()->required(), "YAML file with the workloads to process")
+		("input-dir,i", po::value<string>()->required(), "input data dir")
+		("name,n", po::value<string>()->required(), "exec name")
+		("alone", po::value<double>()->required(), "number of intervals that takes to execute the applications alone, quotient for the slowdown")
+		("output-dir,o", po::value<string>()->default_value("aggrdata"), "output dir")
+		("jobs,j", po::value<uint32_t>()->default_value(std::max(std::thread::hardware_concurrency(), 1U)), "number of files parsed in parallel")
+		;
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		if (vm.count("help"))
+		{
+			cout << desc << endl;
+			return EXIT_SUCCESS;
+		}
+		po::notify(vm);
+	}
+	catch (const std::exception &e)
+	{
+		cerr << e.what() << endl;
+		cout << desc << endl;
+		return EXIT_FAILURE;
+	}
+
+	const string input_dir = vm["input-dir"].as<string>();
+	const string output_dir = vm["output-dir"].as<string>();
+	const double alone = vm["alone"].as<double>();
+
+	// Create output dir and store the name
+	fs::create_directories(output_dir);
+	std::ofstream(output_dir + "/name") << vm["name"].as<string>() << "\n";
+
+	// Read the file with the list of workloads
+	YAML::Node workloads;
+	try
+	{
+		workloads = YAML::LoadFile(vm["workloads"].as<string>());
+	}
+	catch (const std::exception &e)
+	{
+		cerr << "Could not read the workloads: " << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+
+	WorkerPool pool(std::max(vm["jobs"].as<uint32_t>(), 1U));
+
+	// For each workload...
+	for (const auto &node : workloads)
+	{
+		vector<string> wl;
+		if (node.IsScalar())
+			wl.push_back(node.as<string>());
+		else
+			wl = node.as<vector<string>>();
+		try
+		{
+			process_intdata(pool, wl, input_dir, output_dir, alone);
+			process_data(pool, wl, input_dir, output_dir, alone);
+		}
+		catch (const std::exception &e)
+		{
+			cout << "Error in {}: {}"_format(boost::algorithm::join(wl, ", "), e.what()) << endl;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
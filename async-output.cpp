@@ -0,0 +1,217 @@
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "async-output.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+AsyncWriter::Channel::Channel(AsyncWriter &_writer, std::shared_ptr<std::ostream> _sink) :
+		writer(_writer), sink(_sink), last_handover(mono_clock_t::now())
+{
+	reset_put_area(0);
+}
+
+
+// Make the whole buffer writable, keeping the first 'used' bytes
+void AsyncWriter::Channel::reset_put_area(size_t used)
+{
+	buffer.resize(used + chunk_size);
+	setp(&buffer[0], &buffer[0] + buffer.size());
+	pbump(used);
+}
+
+
+void AsyncWriter::Channel::handover()
+{
+	size_t used = pptr() - pbase();
+	last_handover = mono_clock_t::now();
+	if (!used)
+		return;
+
+	buffer.resize(used);
+	if (!full.push(std::move(buffer)))
+	{
+		// The writer is behind, keep the data and make room for more
+		LOGDEB("The output writer is behind, {} bytes stay in memory"_format(used));
+		reset_put_area(used);
+		return;
+	}
+
+	// Reuse the memory of a chunk that has already been written, if any
+	buffer = std::string();
+	empty.pop(buffer);
+	buffer.clear();
+	reset_put_area(0);
+
+	writer.notify();
+}
+
+
+int AsyncWriter::Channel::overflow(int c)
+{
+	handover();
+	if (c != traits_type::eof())
+	{
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+}
+
+
+// Called when the stream is flushed (i.e. std::endl). Only hand the data over from time to time,
+// to write in large batches.
+int AsyncWriter::Channel::sync()
+{
+	if (mono_clock_t::now() - last_handover >= writer.max_delay)
+		handover();
+	return 0;
+}
+
+
+// Check the state of the sink after writing into it. Errors are reported once, when they start, and
+// the state is cleared so the next chunks are tried again (i.e. the disk had been full for a while).
+void AsyncWriter::Channel::check_sink(size_t bytes)
+{
+	if (*sink)
+	{
+		if (failed)
+			LOGINF("The output can be written again");
+		failed = false;
+		return;
+	}
+
+	if (!failed)
+		LOGERR("Could not write {} bytes of output: {}"_format(bytes, strerror(errno)));
+	failed = true;
+	sink->clear();
+}
+
+
+// Write the pending chunks, returns true if there was any
+bool AsyncWriter::Channel::drain()
+{
+	std::string chunk;
+	size_t bytes = 0;
+	while (full.pop(chunk))
+	{
+		sink->write(chunk.data(), chunk.size());
+		check_sink(chunk.size());
+		bytes += chunk.size();
+		chunk.clear();
+		empty.push(std::move(chunk)); // If there is no room, the memory is just freed
+	}
+	if (!bytes)
+		return false;
+	sink->flush();
+	check_sink(bytes);
+	return true;
+}
+
+
+AsyncWriter::AsyncWriter(std::chrono::nanoseconds _max_delay) : max_delay(_max_delay), stop(false)
+{
+	event_fd = eventfd(0, EFD_CLOEXEC);
+	if (event_fd < 0)
+		throw_with_trace(std::runtime_error("Could not create eventfd: {}"_format(strerror(errno))));
+}
+
+
+AsyncWriter::~AsyncWriter()
+{
+	close();
+	if (event_fd >= 0)
+		::close(event_fd);
+}
+
+
+std::shared_ptr<std::ostream> AsyncWriter::wrap(std::shared_ptr<std::ostream> sink)
+{
+	assert(!started);
+	channels.push_back(std::make_unique<Channel>(*this, sink));
+	streams.push_back(std::make_shared<std::ostream>(channels.back().get()));
+	return streams.back();
+}
+
+
+void AsyncWriter::start()
+{
+	assert(!started);
+	thread = std::thread(&AsyncWriter::run, this);
+	started = true;
+}
+
+
+void AsyncWriter::notify()
+{
+	uint64_t one = 1;
+	if (write(event_fd, &one, sizeof(one)) != sizeof(one))
+		LOGERR("Could not wake up the output writer: {}"_format(strerror(errno)));
+}
+
+
+void AsyncWriter::run()
+{
+	// SIGINT must reach the main thread, that is the one that jumps to the cleanup code
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	while (true)
+	{
+		uint64_t count;
+		if (read(event_fd, &count, sizeof(count)) != sizeof(count))
+		{
+			if (errno == EINTR)
+				continue;
+			LOGERR("Could not wait for output: {}"_format(strerror(errno)));
+			return;
+		}
+
+		// Once stopped, nothing else will be handed over
+		bool stopping = stop.load();
+		for (const auto &channel : channels)
+			channel->drain();
+		if (stopping)
+			return;
+	}
+}
+
+
+void AsyncWriter::close()
+{
+	if (!started)
+		return;
+
+	// Hand over what is left, waiting for the writer if it is behind
+	for (auto &stream : streams)
+		stream->flush();
+	for (const auto &channel : channels)
+	{
+		channel->handover();
+		while (channel->pending())
+		{
+			notify();
+			std::this_thread::yield();
+			channel->handover();
+		}
+	}
+
+	stop = true;
+	notify();
+	thread.join();
+	started = false;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sampling-clock.hpp"
+#include "spsc-ring.hpp"
+
+
+// Writes output streams from a thread of its own, so a slow disk or pipe never stalls the main loop.
+// What is written into a wrapped stream is kept in memory and handed to the writer thread in large
+// chunks, through lock-free rings, when the chunk is full or when the stream is flushed and the data
+// has been waiting for longer than 'max_delay'. Each stream must be written by one thread at a time,
+// like any other stream.
+class AsyncWriter
+{
+	class Channel : public std::streambuf
+	{
+		static const size_t chunk_size = 64 * 1024;
+
+		AsyncWriter &writer;
+		std::shared_ptr<std::ostream> sink;
+		std::string buffer; // The put area
+		mono_time_t last_handover;
+		bool failed = false; // The last write into the sink failed, only accessed by the writer
+
+		void reset_put_area(size_t used);
+		void check_sink(size_t bytes);
+
+		protected:
+
+		int overflow(int c) override;
+		int sync() override;
+
+		public:
+
+		SPSCRing<std::string, 64> full;  // Chunks to write, from the producer to the writer
+		SPSCRing<std::string, 64> empty; // Written chunks, given back to the producer to reuse their memory
+
+		Channel(AsyncWriter &_writer, std::shared_ptr<std::ostream> _sink);
+
+		// Give the buffered data to the writer thread, never blocks
+		void handover();
+		size_t pending() const { return pptr() - pbase(); }
+
+		// Writer side
+		bool drain();
+	};
+
+	std::chrono::nanoseconds max_delay;
+	std::vector<std::unique_ptr<Channel>> channels;
+	std::vector<std::shared_ptr<std::ostream>> streams;
+	std::thread thread;
+	std::atomic<bool> stop;
+	int event_fd = -1;
+	bool started = false;
+
+	void notify();
+	void run();
+
+	public:
+
+	AsyncWriter() = delete;
+	AsyncWriter(std::chrono::nanoseconds _max_delay);
+	~AsyncWriter();
+
+	AsyncWriter(const AsyncWriter&) = delete;
+	AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+	// Stream that writes into 'sink' through the writer thread. Must be called before 'start'.
+	std::shared_ptr<std::ostream> wrap(std::shared_ptr<std::ostream> sink);
+
+	void start();
+
+	// Write everything that is pending and stop the thread. The wrapped streams must not be used anymore.
+	void close();
+};
+typedef std::shared_ptr<AsyncWriter> async_writer_ptr_t;
@@ -0,0 +1,170 @@
+#include <cerrno>
+#include <cstring>
+
+#include <signal.h>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "attach.hpp"
+#include "common.hpp"
+#include "log.hpp"
+#include "sched.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using fmt::literals::operator""_format;
+
+
+AttachSpec::Kind attach_kind_from_str(const string &str)
+{
+	if (str == "pid")
+		return AttachSpec::Kind::pid;
+	if (str == "cgroup")
+		return AttachSpec::Kind::cgroup;
+	if (str == "comm")
+		return AttachSpec::Kind::comm;
+	throw_with_trace(std::runtime_error("Unknown attach kind '{}', it should be 'pid', 'cgroup' or 'comm'"_format(str)));
+}
+
+
+const string attach_kind_to_str(AttachSpec::Kind kind)
+{
+	switch (kind)
+	{
+		case AttachSpec::Kind::pid:
+			return "pid";
+		case AttachSpec::Kind::cgroup:
+			return "cgroup";
+		case AttachSpec::Kind::comm:
+			return "comm";
+	}
+	throw_with_trace(std::runtime_error("Unknown attach kind, should not reach this"));
+}
+
+
+// The comm of a process, without the parentheses, or "" if it does not exist anymore
+static
+string pid_comm(pid_t pid)
+{
+	std::ifstream f("/proc/{}/comm"_format(pid));
+	string comm;
+	std::getline(f, comm);
+	return comm;
+}
+
+
+Attacher::Attacher(const std::vector<AttachSpec> &_specs) : specs(_specs)
+{
+	for (const auto &spec : specs)
+	{
+		try
+		{
+			patterns.push_back(spec.kind == AttachSpec::Kind::comm ? std::regex(spec.target) : std::regex());
+		}
+		catch (const std::regex_error &e)
+		{
+			throw_with_trace(std::runtime_error("Invalid comm pattern '{}': {}"_format(spec.target, e.what())));
+		}
+		LOGINF("Attaching to {} '{}'"_format(attach_kind_to_str(spec.kind), spec.target));
+	}
+}
+
+
+std::vector<pid_t> Attacher::find(size_t i) const
+{
+	const auto &spec = specs[i];
+	auto pids = std::vector<pid_t>();
+
+	switch (spec.kind)
+	{
+		case AttachSpec::Kind::pid:
+		{
+			pid_t pid = std::stoi(spec.target);
+			if (kill(pid, 0) == 0 || errno != ESRCH)
+				pids.push_back(pid);
+			break;
+		}
+
+		case AttachSpec::Kind::cgroup:
+		{
+			// The cgroup may not exist yet, or may have been removed
+			std::ifstream f((fs::path(spec.target) / "cgroup.procs").string());
+			pid_t pid;
+			while (f >> pid)
+				pids.push_back(pid);
+			break;
+		}
+
+		case AttachSpec::Kind::comm:
+		{
+			const pid_t self = getpid();
+			for (const auto &entry : fs::directory_iterator("/proc"))
+			{
+				const string dir = entry.path().filename().string();
+				if (dir.find_first_not_of("0123456789") != string::npos)
+					continue;
+				pid_t pid = std::stoi(dir);
+				if (pid == self)
+					continue;
+				if (std::regex_match(pid_comm(pid), patterns[i]))
+					pids.push_back(pid);
+			}
+			break;
+		}
+	}
+
+	return pids;
+}
+
+
+tasklist_t Attacher::scan()
+{
+	auto result = tasklist_t();
+
+	// Forget the processes that are gone. The ones that are still alive stay known even if they are not
+	// tracked anymore (i.e. they have reached their instruction limit), so they are not attached again.
+	for (auto it = known.begin(); it != known.end();)
+	{
+		if (kill(it->first, 0) < 0 && errno == ESRCH)
+			it = known.erase(it);
+		else
+			++it;
+	}
+
+	for (size_t i = 0; i < specs.size(); i++)
+	{
+		const auto &spec = specs[i];
+		for (pid_t pid : find(i))
+		{
+			// The process may exit while we look at it
+			try
+			{
+				const auto stat = sched::Stat(pid);
+				if (stat.state == 'Z')
+					continue;
+
+				const auto it = known.find(pid);
+				if (it != known.end() && it->second == stat.starttime)
+					continue;
+				if (it != known.end())
+					LOGWAR("Pid {} has been reused, attaching to the new process"_format(pid));
+				known[pid] = stat.starttime;
+
+				const string name = spec.name != "" ? spec.name : pid_comm(pid);
+				auto task = std::make_shared<Task>(name, pid, spec.initial_clos, sched::allowed_cpus(pid), spec.max_instr, spec.batch);
+				LOGINF("Task {}:{} attached to pid {}"_format(task->id, task->name, task->pid));
+				result.push_back(task);
+			}
+			catch (const std::exception &e)
+			{
+				LOGDEB("Could not attach to pid {}: {}"_format(pid, e.what()));
+			}
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "task.hpp"
+
+
+// Describes already running processes to be managed
+struct AttachSpec
+{
+	enum class Kind
+	{
+		pid,    // A single process
+		cgroup, // All the processes in a cgroup v2 directory
+		comm,   // All the processes whose comm matches a regular expression
+	};
+
+	Kind kind;
+	std::string target;        // Pid, cgroup directory or regular expression
+	std::string name;          // Name of the tasks, defaults to the comm of each process
+	uint32_t initial_clos = 0; // The CLOS the processes are mapped to when found
+	uint64_t max_instr = 0;    // Stop tracking the process after executing this many instructions
+	bool batch = false;
+};
+AttachSpec::Kind attach_kind_from_str(const std::string &str);
+const std::string attach_kind_to_str(AttachSpec::Kind kind);
+
+
+// Finds the processes described by the attach specs. They have been launched by someone else, so they
+// are never restarted or killed by the manager, only monitored and mapped to CLOSes.
+// Processes can appear and disappear at any time, so the specs are scanned every interval.
+class Attacher
+{
+	const std::vector<AttachSpec> specs;
+	std::vector<std::regex> patterns;   // Compiled comm patterns, by spec
+	std::map<pid_t, long long> known;   // Start time of the processes already attached, to detect pid reuse
+
+	std::vector<pid_t> find(size_t spec) const;
+
+	public:
+
+	Attacher() = delete;
+	Attacher(const std::vector<AttachSpec> &_specs);
+
+	// Create tasks for the processes that have appeared since the previous scan. A process is only
+	// attached once, a reused pid is detected by its start time.
+	tasklist_t scan();
+};
+typedef std::shared_ptr<Attacher> attacher_ptr_t;
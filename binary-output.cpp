@@ -0,0 +1,146 @@
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include <fmt/format.h>
+
+#include "binary-output.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The binary output is written in the native byte order, which must be little-endian");
+
+
+size_t binout::Column::size() const
+{
+	if (type == "<u4" || type == "<i4")
+		return 4;
+	if (type == "<f8")
+		return 8;
+	throw_with_trace(std::runtime_error("Unknown type '{}' for the column '{}'"_format(type, name)));
+}
+
+
+template <typename T>
+static
+void append(std::string &s, T value)
+{
+	s.append((const char *) &value, sizeof(value));
+}
+
+
+// Append a string preceded by its length, as a value of type T
+template <typename T>
+static
+void append_string(std::string &s, const std::string &value)
+{
+	if (value.size() > std::numeric_limits<T>::max())
+		throw_with_trace(std::runtime_error("'{}' is too long for the binary output, the limit is {} bytes"_format(value, std::numeric_limits<T>::max())));
+	append<T>(s, value.size());
+	s += value;
+}
+
+
+static
+void pad(std::string &s)
+{
+	s.append((8 - s.size() % 8) % 8, '\0');
+}
+
+
+BinaryOutput::BinaryOutput(std::shared_ptr<std::ostream> _out) : out(_out)
+{
+	out->write(binout::magic, sizeof(binout::magic));
+	std::string header;
+	append<uint32_t>(header, binout::version);
+	append<uint32_t>(header, 0);
+	out->write(header.data(), header.size());
+}
+
+
+void BinaryOutput::write_chunk(binout::Chunk kind, const std::string &payload)
+{
+	std::string header;
+	append<uint32_t>(header, (uint32_t) kind);
+	append<uint32_t>(header, 0);
+	append<uint64_t>(header, payload.size());
+	out->write(header.data(), header.size());
+	out->write(payload.data(), payload.size());
+}
+
+
+void BinaryOutput::write_schema(const Task &task)
+{
+	assert(columns.empty());
+
+	// The fixed part keeps the doubles aligned
+	columns = {{"interval", "<u4"}, {"app", "<u4"}, {"CPU", "<i4"}, {"_pad", "<u4"}, {"compl", "<f8"}};
+	for (const auto &name : task.stats.column_names())
+		columns.push_back({name, "<f8"});
+
+	std::string payload;
+	record_size = 0;
+	for (const auto &col : columns)
+		record_size += col.size();
+	append<uint32_t>(payload, columns.size());
+	append<uint32_t>(payload, record_size);
+	for (const auto &col : columns)
+	{
+		append_string<uint8_t>(payload, col.name);
+		append_string<uint8_t>(payload, col.type);
+	}
+	pad(payload);
+	write_chunk(binout::Chunk::schema, payload);
+
+	values.resize(task.stats.num_columns());
+}
+
+
+void BinaryOutput::write_interval(const Task &task, uint64_t interval)
+{
+	static const metric_t instructions = Stats::metric("instructions");
+
+	assert(!columns.empty());
+	if (task.stats.num_columns() != values.size())
+		throw_with_trace(std::runtime_error("Task {}:{} does not have the columns of the binary output"_format(task.id, task.name)));
+
+	// The name of the app goes before its first record
+	if (!apps.count(task.id))
+	{
+		flush();
+		std::string payload;
+		append<uint32_t>(payload, 1);
+		append<uint32_t>(payload, task.id);
+		append_string<uint16_t>(payload, task.name);
+		pad(payload);
+		write_chunk(binout::Chunk::apps, payload);
+		apps.insert(task.id);
+	}
+
+	double completed = task.max_instr ?
+			(double) task.stats.sum(instructions) / (double) task.max_instr :
+			NAN;
+	task.stats.data_int(values.data());
+
+	size_t start = records.size();
+	append<uint32_t>(records, interval);
+	append<uint32_t>(records, task.id);
+	append<int32_t>(records, task.cpu);
+	append<uint32_t>(records, 0);
+	append<double>(records, completed);
+	records.append((const char *) values.data(), values.size() * sizeof(double));
+	assert(records.size() - start == record_size);
+	(void) start;
+}
+
+
+void BinaryOutput::flush()
+{
+	if (records.empty())
+		return;
+	write_chunk(binout::Chunk::records, records);
+	records.clear(); // Keeps the memory for the next interval
+	out->flush();
+}
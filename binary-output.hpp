@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "task.hpp"
+
+
+// Binary output of the interval stats, for analyzing long runs without parsing text.
+//
+// The file starts with a header (the magic "CPABIN\0\0", the version as a uint32 and 4 reserved bytes)
+// followed by chunks. Every chunk has a header of 16 bytes (kind and reserved as uint32, and the size
+// of the payload as uint64) and its payload, padded to 8 bytes. All the values are little-endian.
+//
+//  - schema: number of columns and size of a record (uint32), then the name and the numpy type of every
+//    column (i.e. '<f8'), each one preceded by its length (uint8). It is the first chunk.
+//  - apps: number of apps (uint32), then the id (uint32) and the name, preceded by its length (uint16),
+//    of every app. Written before the first record of an app.
+//  - records: fixed-width records, one for each app and interval, following the schema.
+//
+// Records are written in a chunk per interval, so the file can be read up to the last complete chunk
+// while it is still being written.
+namespace binout
+{
+	const char magic[8] = {'C', 'P', 'A', 'B', 'I', 'N', '\0', '\0'};
+	const uint32_t version = 1;
+
+	enum class Chunk : uint32_t {schema = 1, apps = 2, records = 3};
+
+	struct Column
+	{
+		std::string name;
+		std::string type; // numpy type: <u4, <i4 or <f8
+		size_t size() const;
+	};
+}
+
+
+class BinaryOutput
+{
+	std::shared_ptr<std::ostream> out;
+	std::vector<binout::Column> columns;
+	size_t record_size = 0;
+	std::set<uint32_t> apps;     // Apps whose name has been written
+	std::string records;         // Records of the current chunk
+	std::vector<double> values;  // Scratch space for the stats of a task
+
+	void write_chunk(binout::Chunk kind, const std::string &payload);
+
+	public:
+
+	BinaryOutput() = delete;
+	BinaryOutput(std::shared_ptr<std::ostream> _out);
+
+	// The columns are taken from the stats of the task, all the tasks have the same ones
+	void write_schema(const Task &task);
+
+	void write_interval(const Task &task, uint64_t interval);
+
+	// End the chunk of records of the interval
+	void flush();
+};
+typedef std::shared_ptr<BinaryOutput> binout_ptr_t;
@@ -57,6 +57,9 @@ void NoPart::apply(uint64_t current_interval, const tasklist_t &tasklist)
 	LOGINF("CAT Policy name: NoPart");
 	LOGINF("Using {} stats"_format(stats));
 
+	static const metric_t instructions = Stats::metric("instructions");
+	static const metric_t cycles = Stats::metric("cycles");
+
 	for (const auto &task_ptr : tasklist)
 	{
 		const Task &task = *task_ptr;
@@ -69,14 +72,14 @@ void NoPart::apply(uint64_t current_interval, const tasklist_t &tasklist)
 		if (stats == "total")
 		{
 			// Cycles and IPnC
-			inst = task.stats.sum("instructions");
-			cycl = task.stats.sum("cycles");
+			inst = task.stats.sum(instructions);
+			cycl = task.stats.sum(cycles);
 		}
 		else if (stats == "interval")
 		{
 			// Cycles and IPnC
-			inst = task.stats.last("instructions");
-			cycl = task.stats.last("cycles");
+			inst = task.stats.last(instructions);
+			cycl = task.stats.last(cycles);
 		}
 
 		ipc = inst / cycl;
@@ -176,6 +179,13 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 
 	LOGINF("CAT Policy name: Critical-Aware");
 
+	// Handles of the metrics, resolved only once
+	static const metric_t l3_miss_id = Stats::metric("mem_load_uops_retired.l3_miss");
+	static const metric_t inst_id = Stats::metric("instructions");
+	static const metric_t ipc_id = Stats::metric("ipc");
+	static const metric_t l3_occup_id = Stats::metric("intel_cqm/llc_occupancy/");
+	static const metric_t mpkil3_id = Stats::metric("mpkil3"); // If it has been declared as a derived metric
+
 	// Gather data
 	for (const auto &task_ptr : tasklist)
 	{
@@ -185,14 +195,16 @@ void CriticalAware::apply(uint64_t current_interval, const tasklist_t &tasklist)
 		uint32_t cpu = task.cpus.front();
 
 		// stats per interval
-		uint64_t l3_miss = task.stats.last("mem_load_uops_retired.l3_miss");
-		uint64_t inst = task.stats.last("instructions");
-		double ipc = task.stats.last("ipc");
-		double l3_occup_mb = task.stats.last("intel_cqm/llc_occupancy/") / 1024 / 1024;
+		uint64_t l3_miss = task.stats.last(l3_miss_id);
+		uint64_t inst = task.stats.last(inst_id);
+		double ipc = task.stats.last(ipc_id);
+		double l3_occup_mb = task.stats.last(l3_occup_id) / 1024 / 1024;
 
 		l3_occup_mb_total += l3_occup_mb;
 
-		double MPKIL3 = (double)(l3_miss * 1000) / (double)inst;
+		double MPKIL3 = task.stats.has(mpkil3_id) ?
+				task.stats.last(mpkil3_id) :
+				(double)(l3_miss * 1000) / (double)inst;
 
 		// LOGINF("Task {}: MPKI_L3 = {}"_format(taskName,MPKIL3));
 		LOGINF("Task {} ({}): IPC = {}, MPKI_L3 = {}, l3_occup_mb {}"_format(taskName, taskPID, ipc,
@@ -900,12 +912,12 @@ void CriticalPhaseAware::isolate_application(uint32_t taskID, pid_t taskPID,
 	taskIsInCRCLOS.push_back(std::make_pair(taskID, CLOS_isolated));
 }
 
-void CriticalPhaseAware::include_application(uint32_t taskID, pid_t taskPID,
-										  std::vector<pair_t>::iterator it, uint64_t CLOSvalue)
+void CriticalPhaseAware::release_isolated_clos(uint32_t taskID, uint64_t CLOSvalue)
 {
 	isolated_closes.insert(isolated_closes.begin(), CLOSvalue);
 	LOGINF("[ISO] CLOS {} pushed back to isolated_closes"_format(CLOSvalue));
 	n_isolated_apps--;
+	// The remaining isolated app gets the whole isolated partition
 	if (n_isolated_apps == 1) {
 		if (CLOSvalue == 5)
 			LinuxBase::get_cat()->set_cbm(6, mask_iso_1);
@@ -915,6 +927,12 @@ void CriticalPhaseAware::include_application(uint32_t taskID, pid_t taskPID,
 	LOGINF("[ISO] n_isolated_apps = {}"_format(n_isolated_apps));
 	id_isolated.erase(std::remove(id_isolated.begin(), id_isolated.end(), taskID),
 					  id_isolated.end());
+}
+
+void CriticalPhaseAware::include_application(uint32_t taskID, pid_t taskPID,
+										  std::vector<pair_t>::iterator it, uint64_t CLOSvalue)
+{
+	release_isolated_clos(taskID, CLOSvalue);
 
 	LinuxBase::get_cat()->add_task(1, taskPID);
 	it = taskIsInCRCLOS.erase(it);
@@ -923,6 +941,44 @@ void CriticalPhaseAware::include_application(uint32_t taskID, pid_t taskPID,
 	LOGINF("[ISO] {}: return to CLOS 1"_format(taskID));
 }
 
+void CriticalPhaseAware::task_removed(const Task &task)
+{
+	const uint32_t taskID = task.id;
+	auto it = std::find_if(
+			taskIsInCRCLOS.begin(), taskIsInCRCLOS.end(),
+			[&taskID](const auto &tuple) { return std::get<0>(tuple) == taskID; });
+
+	// New entries are added the first time the policy sees the task
+	if (it != taskIsInCRCLOS.end())
+	{
+		uint64_t CLOSvalue = std::get<1>(*it);
+		switch (CLOSvalue)
+		{
+			case 2:
+			case 3:
+			case 4: // Critical
+				CLOS_critical.insert(CLOSvalue);
+				LLCoccup_critical.erase(taskID);
+				critical_apps--;
+				break;
+
+			case 5:
+			case 6: // Isolated
+				release_isolated_clos(taskID, CLOSvalue);
+				break;
+		}
+		taskIsInCRCLOS.erase(it);
+		LOGINF("Task {} removed, it was in CLOS {}"_format(taskID, CLOSvalue));
+	}
+
+	valid_mpkil3.erase(taskID);
+	ipc_phase_duration.erase(taskID);
+	ipc_sumXij.erase(taskID);
+	limit_task.erase(taskID);
+	excluded.erase(taskID);
+}
+
+
 void CriticalPhaseAware::divide_3_critical(uint64_t clos, bool limitDone)
 {
 	uint64_t schem = LinuxBase::get_cat()->get_cbm(clos);
@@ -1032,6 +1088,15 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 	// Number of critical apps found in the interval
 	bool change_in_outliers = false;
 
+	// Handles of the metrics, resolved only once
+	static const metric_t l3_miss_id = Stats::metric("mem_load_uops_retired.l3_miss");
+	static const metric_t l3_hit_id = Stats::metric("mem_load_uops_retired.l3_hit");
+	static const metric_t inst_id = Stats::metric("instructions");
+	static const metric_t ipc_id = Stats::metric("ipc");
+	static const metric_t l3_occup_id = Stats::metric("intel_cqm/llc_occupancy/");
+	static const metric_t mpkil3_id = Stats::metric("mpkil3"); // If they have been declared as derived metrics
+	static const metric_t hpkil3_id = Stats::metric("hpkil3");
+
 	// Gather data
 	LOGINF("—————– STEPS 1 & 2 —————–");
 	for (const auto &task_ptr : tasklist) {
@@ -1042,14 +1107,18 @@ void CriticalPhaseAware::apply(uint64_t current_interval, const tasklist_t &task
 		double my_sum, prev_sum;
 
 		// stats per interval
-		uint64_t l3_miss = task.stats.last("mem_load_uops_retired.l3_miss");
-		uint64_t l3_hit = task.stats.last("mem_load_uops_retired.l3_hit");
-		uint64_t inst = task.stats.last("instructions");
-		double ipc = task.stats.last("ipc");
-		double l3_occup_mb = task.stats.last("intel_cqm/llc_occupancy/") / 1024 / 1024;
+		uint64_t l3_miss = task.stats.last(l3_miss_id);
+		uint64_t l3_hit = task.stats.last(l3_hit_id);
+		uint64_t inst = task.stats.last(inst_id);
+		double ipc = task.stats.last(ipc_id);
+		double l3_occup_mb = task.stats.last(l3_occup_id) / 1024 / 1024;
 		l3_occup_mb_total += l3_occup_mb;
-		double MPKIL3 = (double)(l3_miss * 1000) / (double)inst;
-		double HPKIL3 = (double)(l3_hit * 1000) / (double)inst;
+		double MPKIL3 = task.stats.has(mpkil3_id) ?
+				task.stats.last(mpkil3_id) :
+				(double)(l3_miss * 1000) / (double)inst;
+		double HPKIL3 = task.stats.has(hpkil3_id) ?
+				task.stats.last(hpkil3_id) :
+				(double)(l3_hit * 1000) / (double)inst;
 
 		LOGINF("Task {} ({}): IPC = {}, HPKIL3 = {}, MPKIL3 = {}, l3_occup_mb {}"_format(
 				taskName, taskID, ipc, HPKIL3, MPKIL3, l3_occup_mb));
@@ -281,12 +281,16 @@ class CriticalPhaseAware: public LinuxBase
 
     //configure CAT
 	void update_configuration(std::vector<pair_t> v, std::vector<pair_t> status, uint64_t num_critical_old, uint64_t num_critical_new);
+	void release_isolated_clos(uint32_t taskID, uint64_t CLOSvalue);
 	void include_application(uint32_t taskID, pid_t taskPID, std::vector<pair_t>::iterator it, uint64_t CLOSvalue);
 	void isolate_application(uint32_t taskID, pid_t taskPID, std::vector<pair_t>::iterator it);
 	void divide_half_ways_critical(uint64_t clos, uint32_t cr_apps);
 	void divide_3_critical(uint64_t clos, bool limitDone);
 	virtual void apply(uint64_t current_interval, const tasklist_t &tasklist);
 
+	// Release the CLOS of a task that is gone and forget its history
+	virtual void task_removed(const Task &task) override;
+
 };
 typedef CriticalPhaseAware CPA;
 
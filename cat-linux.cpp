@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -166,11 +167,11 @@ std::vector<std::string> CATLinux::get_tasks(fs::path clos_dir) const
 void CATLinux::add_task(fs::path clos_dir, pid_t pid)
 {
 	assert_dir_exists(clos_dir);
+	auto children = std::vector<pid_t>();
 	try
 	{
 		std::ofstream f = open_ofstream(clos_dir / "tasks");
 		f << pid << std::endl;
-		auto children = std::vector<pid_t>();
 		pid_get_children_rec(pid, children);
 		for (const auto &child_pid : children)
 			f << child_pid << std::endl;
@@ -179,6 +180,12 @@ void CATLinux::add_task(fs::path clos_dir, pid_t pid)
 	{
 		throw_with_trace(std::runtime_error("Cannot write pid '{}' into '{}'"_format(pid, (clos_dir / "tasks").string())));
 	}
+
+	uint32_t clos = clos_dir == fs::path(ROOT) ? 0 : std::stoi(fs::basename(clos_dir));
+	std::lock_guard<std::mutex> lock(task_mutex);
+	task_clos[pid] = clos;
+	for (const auto &child_pid : children)
+		task_clos[child_pid] = clos;
 }
 
 
@@ -199,6 +206,9 @@ void CATLinux::remove_task(std::string task)
 {
 	std::ofstream f = open_ofstream(fs::path(ROOT) / "tasks");
 	f << task << std::endl;
+
+	std::lock_guard<std::mutex> lock(task_mutex);
+	task_clos[std::stoi(task)] = 0;
 }
 
 
@@ -249,11 +259,32 @@ void CATLinux::init()
 	info = infomap["L3"];
 	reset();
 	create_all_clos();
+	load_cache();
+}
+
+
+void CATLinux::load_cache()
+{
+	cbms.resize(get_max_closids());
+	clos_cpus.resize(get_max_closids());
+	for (uint32_t clos = 0; clos < get_max_closids(); clos++)
+	{
+		cbms[clos] = get_schemata(intel_to_linux(clos));
+		clos_cpus[clos] = get_cpus(intel_to_linux(clos));
+	}
+	cached = true;
+	LOGDEB("CAT state loaded from resctrl{}"_format(verify ? ", it will be verified on every read" : ""));
 }
 
 
 void CATLinux::reset()
 {
+	// The CLOSes are deleted, the mirror is not valid anymore, and all the tasks go back to CLOS 0
+	cached = false;
+	{
+		std::lock_guard<std::mutex> lock(task_mutex);
+		task_clos.clear();
+	}
 	delete_all_clos();
 
 	create_all_clos();
@@ -269,26 +300,61 @@ void CATLinux::reset()
 void CATLinux::set_cbm(uint32_t clos, uint64_t cbm)
 {
 	set_schemata(intel_to_linux(clos), cbm);
+	if (cached)
+		cbms.at(clos) = cbm;
 }
 
 
 uint64_t CATLinux::get_cbm(uint32_t clos) const
 {
-	return get_schemata(intel_to_linux(clos));
+	if (!cached)
+		return get_schemata(intel_to_linux(clos));
+
+	uint64_t cbm = cbms.at(clos);
+	if (verify)
+	{
+		uint64_t real = get_schemata(intel_to_linux(clos));
+		if (real != cbm)
+		{
+			LOGERR("The cached mask of CLOS {} is {:#x}, but resctrl has {:#x}"_format(clos, cbm, real));
+			return real;
+		}
+	}
+	return cbm;
 }
 
 
 void CATLinux::add_cpu(uint32_t clos, uint32_t cpu)
 {
 	fs::path clos_dir = intel_to_linux(clos);
-	uint64_t cpu_mask = get_cpus(clos_dir);
-	cpu_mask |= (1ULL << cpu);
-	set_cpus(clos_dir, cpu_mask);
+	uint64_t cpu_bit = 1ULL << cpu;
+	uint64_t cpu_mask = cached ? clos_cpus.at(clos) : get_cpus(clos_dir);
+	set_cpus(clos_dir, cpu_mask | cpu_bit);
+
+	// A CPU belongs to a single CLOS, resctrl takes it out of the one it was in
+	if (cached)
+	{
+		for (auto &mask : clos_cpus)
+			mask &= ~cpu_bit;
+		clos_cpus[clos] |= cpu_bit;
+	}
 }
 
 
 uint32_t CATLinux::get_clos(uint32_t cpu) const
 {
+	if (cached)
+	{
+		uint64_t cpu_bit = 1ULL << cpu;
+		auto it = std::find_if(clos_cpus.begin(), clos_cpus.end(), [cpu_bit](uint64_t mask) { return mask & cpu_bit; });
+		if (it == clos_cpus.end())
+			throw_with_trace(std::runtime_error("CPU {} is not in any CLOS, does it exist?"_format(cpu)));
+		uint32_t clos = it - clos_cpus.begin();
+		if (!verify || get_cpus(intel_to_linux(clos)) & cpu_bit)
+			return clos;
+		LOGERR("CPU {} is in CLOS {} according to the cache, but not according to resctrl"_format(cpu, clos));
+	}
+
 	auto path = get_clos_dir(cpu);
 	if (path == fs::path(ROOT))
 		return 0;
@@ -304,6 +370,67 @@ uint32_t CATLinux::get_max_closids() const
 
 
 uint32_t CATLinux::get_clos_of_task(pid_t pid) const
+{
+	{
+		std::lock_guard<std::mutex> lock(task_mutex);
+		auto it = task_clos.find(pid);
+		if (it != task_clos.end())
+		{
+			if (!verify)
+				return it->second;
+			uint32_t clos = it->second;
+			uint32_t real = find_clos_of_task(pid);
+			if (real != clos)
+			{
+				LOGERR("Task {} is in CLOS {} according to the cache, but in CLOS {} according to resctrl"_format(pid, clos, real));
+				it->second = real;
+			}
+			return real;
+		}
+	}
+
+	// Not known yet (i.e. it has just been restarted), it is searched only once
+	uint32_t clos = find_clos_of_task(pid);
+	std::lock_guard<std::mutex> lock(task_mutex);
+	task_clos[pid] = clos;
+	return clos;
+}
+
+
+void CATLinux::forget_task(pid_t pid)
+{
+	std::lock_guard<std::mutex> lock(task_mutex);
+	task_clos.erase(pid);
+}
+
+
+// Read the tasks file of every CLOS once, instead of once per task
+void CATLinux::reconcile_tasks()
+{
+	std::unordered_map<pid_t, uint32_t> found;
+	for (uint32_t clos = 0; clos < get_max_closids(); clos++)
+		for (const auto &task : get_tasks(intel_to_linux(clos)))
+			found[std::stoi(task)] = clos;
+
+	std::lock_guard<std::mutex> lock(task_mutex);
+	for (auto it = task_clos.begin(); it != task_clos.end();)
+	{
+		auto real = found.find(it->first);
+		if (real == found.end())
+		{
+			it = task_clos.erase(it); // The task does not exist anymore
+			continue;
+		}
+		if (real->second != it->second)
+			LOGWAR("Task {} was in CLOS {} according to the cache, but it is in CLOS {}"_format(it->first, it->second, real->second));
+		it->second = real->second;
+		++it;
+	}
+}
+
+
+// Look for the task in the resctrl directories
+uint32_t CATLinux::find_clos_of_task(pid_t pid) const
 {
 	auto path = fs::path(ROOT);
 	auto tasks = get_tasks(path);
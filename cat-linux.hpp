@@ -19,6 +19,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <cstdint>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 
 #include <boost/filesystem.hpp>
 
@@ -46,6 +48,21 @@ class CATLinux : public CAT
 
 	CATInfo info;
 
+	// Write-through mirror of the masks and CPUs of every CLOS, so reading them does not touch resctrl.
+	// It is loaded once the CLOSes exist, and not used while they are being deleted or created. With
+	// 'verify', every read from the mirror is checked against resctrl.
+	bool cached = false;
+	bool verify = false;
+	std::vector<uint64_t> cbms;
+	std::vector<uint64_t> clos_cpus;
+	void load_cache();
+
+	// CLOS of the tasks that have been added or looked up. A pid is only searched in resctrl the first
+	// time, and after reconciling. Lookups may come from several threads.
+	mutable std::mutex task_mutex;
+	mutable std::unordered_map<pid_t, uint32_t> task_clos;
+	uint32_t find_clos_of_task(pid_t pid) const;
+
 	#define FS boost::filesystem
 	void set_schemata(FS::path clos_dir, uint64_t mask);
 	void set_cpus(FS::path clos_dir, uint64_t cpu_mask);
@@ -69,6 +86,9 @@ class CATLinux : public CAT
 	public:
 
 	CATLinux() = default;
+	CATLinux(bool _verify) : verify(_verify) {}
+
+	bool get_verify() const { return verify; }
 
 	/* CAT API */
 	void init() override;
@@ -88,6 +108,10 @@ class CATLinux : public CAT
 	void add_tasks(uint32_t clos, const std::vector<pid_t> &pids);
 
 	uint32_t get_clos_of_task(pid_t pid) const;
+	// The task has exited, its pid may be reused
+	void forget_task(pid_t pid);
+	// Rebuild the CLOS of the known tasks from resctrl
+	void reconcile_tasks();
 };
 
 typedef std::shared_ptr<CATLinux> catlinux_ptr_t;
@@ -48,6 +48,11 @@ class Base
 	// Derived classes should perform their operations here.
 	// The base class does nothing by default.
 	virtual void apply(uint64_t, const tasklist_t &) {}
+
+	// Called when a task joins or leaves the workload in the middle of the execution, so derived
+	// classes can keep their per-task state up to date. The base class does nothing by default.
+	virtual void task_added(const Task &) {}
+	virtual void task_removed(const Task &) {}
 };
 
 
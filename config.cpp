@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <map>
+#include <random>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <yaml-cpp/yaml.h>
@@ -37,6 +38,10 @@ using fmt::literals::operator""_format;
 static std::shared_ptr<cat::policy::Base> config_read_cat_policy(const YAML::Node &config);
 static vector<Cos> config_read_cos(const YAML::Node &config);
 static tasklist_t config_read_tasks(const YAML::Node &config);
+static vector<AttachSpec> config_read_attach(const YAML::Node &config);
+static void config_read_arrivals(const YAML::Node &config, tasklist_t &tasklist);
+static vector<DerivedMetric> config_read_derived_metrics(const YAML::Node &config);
+static QuantileMetrics config_read_quantiles(const YAML::Node &config);
 static YAML::Node merge(YAML::Node user, YAML::Node def);
 static void config_check_required_fields(const YAML::Node &node, const std::vector<string> &required);
 static void config_check_fields(const YAML::Node &node, const std::vector<string> &required, std::vector<string> allowed);
@@ -192,7 +197,7 @@ tasklist_t config_read_tasks(const YAML::Node &config)
 	for (size_t i = 0; i < tasks.size(); i++)
 	{
 		required = {"app"};
-		allowed  = {"max_instr", "max_restarts", "define", "initial_clos", "cpus", "batch"};
+		allowed  = {"max_instr", "max_restarts", "define", "initial_clos", "cpus", "batch", "start_at"};
 		config_check_fields(tasks[i], required, allowed);
 
 		if (!tasks[i]["app"])
@@ -275,12 +280,169 @@ tasklist_t config_read_tasks(const YAML::Node &config)
 
 		bool batch = tasks[i]["batch"] ? tasks[i]["batch"].as<bool>() : false;
 
-		result.push_back(std::make_shared<Task>(name, cmd, initial_clos, cpus, output, input, error, skel, max_instr, max_restarts, batch));
+		auto task = std::make_shared<Task>(name, cmd, initial_clos, cpus, output, input, error, skel, max_instr, max_restarts, batch);
+
+		// Arrival time, either an interval number or a number of seconds with an 's' suffix
+		if (tasks[i]["start_at"])
+		{
+			string start_at = tasks[i]["start_at"].as<string>();
+			task->start_set = true;
+			try
+			{
+				size_t pos;
+				if (start_at.back() == 's')
+				{
+					task->start_seconds = std::stod(start_at, &pos);
+					if (pos != start_at.size() - 1 || task->start_seconds < 0)
+						throw std::invalid_argument(start_at);
+				}
+				else
+				{
+					task->start_interval = std::stoul(start_at, &pos);
+					if (pos != start_at.size())
+						throw std::invalid_argument(start_at);
+				}
+			}
+			catch (const std::logic_error &e)
+			{
+				throw_with_trace(std::runtime_error("Invalid start_at '{}', it should be an interval or a number of seconds followed by 's'"_format(start_at)));
+			}
+		}
+
+		result.push_back(task);
 	}
 	return result;
 }
 
 
+// Generate the arrival times of the tasks that do not have an explicit start_at, in config order
+static
+void config_read_arrivals(const YAML::Node &config, tasklist_t &tasklist)
+{
+	YAML::Node arrivals = config["arrivals"];
+	config_check_fields(arrivals, {"distribution"}, {"mean", "min", "max", "seed"});
+
+	string distribution = arrivals["distribution"].as<string>();
+	auto seed = arrivals["seed"] ? arrivals["seed"].as<uint64_t>() : std::random_device()();
+	std::mt19937_64 gen(seed);
+
+	// Inter-arrival times, in seconds
+	std::function<double()> next;
+	if (distribution == "fixed" || distribution == "exponential")
+	{
+		if (!arrivals["mean"])
+			throw_with_trace(std::runtime_error("The {} arrival distribution requires the field 'mean'"_format(distribution)));
+		double mean = arrivals["mean"].as<double>();
+		if (mean <= 0)
+			throw_with_trace(std::runtime_error("The mean of the arrival distribution must be positive"));
+		if (distribution == "fixed")
+			next = [mean]() { return mean; };
+		else
+			next = [mean, &gen]() { return std::exponential_distribution<double>(1 / mean)(gen); };
+	}
+	else if (distribution == "uniform")
+	{
+		if (!arrivals["min"] || !arrivals["max"])
+			throw_with_trace(std::runtime_error("The uniform arrival distribution requires the fields 'min' and 'max'"));
+		double min = arrivals["min"].as<double>();
+		double max = arrivals["max"].as<double>();
+		if (min < 0 || max < min)
+			throw_with_trace(std::runtime_error("The uniform arrival distribution requires 0 <= min <= max"));
+		next = [min, max, &gen]() { return std::uniform_real_distribution<double>(min, max)(gen); };
+	}
+	else
+	{
+		throw_with_trace(std::runtime_error("Unknown arrival distribution '{}', it should be 'fixed', 'uniform' or 'exponential'"_format(distribution)));
+	}
+
+	// The first task arrives at the beginning
+	LOGINF("Arrivals: {} distribution with seed {}"_format(distribution, seed));
+	double time = 0;
+	for (const auto &task : tasklist)
+	{
+		if (task->start_set)
+			continue;
+		task->start_seconds = time;
+		LOGINF("Task {}:{} arrives at {} s"_format(task->id, task->name, time));
+		time += next();
+	}
+}
+
+
+static
+vector<AttachSpec> config_read_attach(const YAML::Node &config)
+{
+	YAML::Node attach = config["attach"];
+	auto result = vector<AttachSpec>();
+	const vector<string> kinds = {"pid", "cgroup", "comm"};
+	for (size_t i = 0; i < attach.size(); i++)
+	{
+		config_check_fields(attach[i], {}, {"pid", "cgroup", "comm", "name", "initial_clos", "max_instr", "batch"});
+
+		// Exactly one way of finding the processes
+		AttachSpec spec;
+		size_t found = 0;
+		for (const auto &kind : kinds)
+		{
+			if (attach[i][kind])
+			{
+				spec.kind = attach_kind_from_str(kind);
+				spec.target = attach[i][kind].as<string>();
+				found++;
+			}
+		}
+		if (found != 1)
+			throw_with_trace(std::runtime_error("Each attach entry must have exactly one of the keys 'pid', 'cgroup' or 'comm'"));
+
+		spec.name = attach[i]["name"] ? attach[i]["name"].as<string>() : "";
+		spec.initial_clos = attach[i]["initial_clos"] ? attach[i]["initial_clos"].as<decltype(spec.initial_clos)>() : 0;
+		spec.max_instr = attach[i]["max_instr"] ? attach[i]["max_instr"].as<decltype(spec.max_instr)>() : 0;
+		spec.batch = attach[i]["batch"] ? attach[i]["batch"].as<bool>() : false;
+
+		result.push_back(spec);
+	}
+	return result;
+}
+
+
+static
+vector<DerivedMetric> config_read_derived_metrics(const YAML::Node &config)
+{
+	YAML::Node metrics = config["derived_metrics"];
+	auto result = vector<DerivedMetric>();
+	for (size_t i = 0; i < metrics.size(); i++)
+	{
+		config_check_fields(metrics[i], {"name", "expr"}, {});
+
+		string name = metrics[i]["name"].as<string>();
+		string expr = metrics[i]["expr"].as<string>();
+		result.push_back(DerivedMetric(name, expr)); // Parsed here, so errors are found right away
+		LOGINF("Derived metric '{}' = {}"_format(name, expr));
+	}
+	return result;
+}
+
+
+static
+QuantileMetrics config_read_quantiles(const YAML::Node &config)
+{
+	const auto &quantiles = config["quantiles"];
+	config_check_fields(quantiles, {}, {"metrics", "window"});
+
+	auto result = QuantileMetrics();
+	if (quantiles["metrics"])
+	{
+		result.names = quantiles["metrics"].as<decltype(result.names)>();
+		result.required = true;
+	}
+	if (quantiles["window"])
+		result.window = quantiles["window"].as<decltype(result.window)>();
+	if (result.window == 0)
+		throw_with_trace(std::runtime_error("The window of the quantiles must have at least one interval"));
+	return result;
+}
+
+
 static
 YAML::Node merge(YAML::Node user, YAML::Node def)
 {
@@ -348,7 +510,7 @@ void config_read_cmd_options(const YAML::Node &config, CmdOptions &cmd_options)
 	vector<string> allowed;
 
 	required = {};
-	allowed  = {"ti", "mi", "event", "cpu-affinity", "cat-impl"};
+	allowed  = {"ti", "mi", "event", "cpu-affinity", "cat-impl", "cat-verify", "collect-threads", "pipeline", "pause-mode", "async-output", "output-flush"};
 
 	// Check minimum required fields
 	config_check_fields(cmd, required, allowed);
@@ -363,10 +525,22 @@ void config_read_cmd_options(const YAML::Node &config, CmdOptions &cmd_options)
 		cmd_options.cpu_affinity = cmd["cpu-affinity"].as<decltype(cmd_options.cpu_affinity)>();
 	if (cmd["cat-impl"])
 		cmd_options.cat_impl = cmd["cat-impl"].as<decltype(cmd_options.cat_impl)>();
+	if (cmd["cat-verify"])
+		cmd_options.cat_verify = cmd["cat-verify"].as<decltype(cmd_options.cat_verify)>();
+	if (cmd["collect-threads"])
+		cmd_options.collect_threads = cmd["collect-threads"].as<decltype(cmd_options.collect_threads)>();
+	if (cmd["pipeline"])
+		cmd_options.pipeline = cmd["pipeline"].as<decltype(cmd_options.pipeline)>();
+	if (cmd["pause-mode"])
+		cmd_options.pause_mode = cmd["pause-mode"].as<decltype(cmd_options.pause_mode)>();
+	if (cmd["async-output"])
+		cmd_options.async_output = cmd["async-output"].as<decltype(cmd_options.async_output)>();
+	if (cmd["output-flush"])
+		cmd_options.output_flush = cmd["output-flush"].as<decltype(cmd_options.output_flush)>();
 }
 
 
-void config_read(const string &path, const string &overlay, CmdOptions &cmd_options, tasklist_t &tasklist, vector<Cos> &coslist, std::shared_ptr<cat::policy::Base> &catpol, sched::ptr_t &sched)
+void config_read(const string &path, const string &overlay, CmdOptions &cmd_options, tasklist_t &tasklist, vector<AttachSpec> &attachlist, vector<Cos> &coslist, std::shared_ptr<cat::policy::Base> &catpol, sched::ptr_t &sched, vector<DerivedMetric> &derived, QuantileMetrics &quantiles)
 {
 	// The message outputed by YAML is not clear enough, so we test first
 	std::ifstream f(path);
@@ -393,6 +567,26 @@ void config_read(const string &path, const string &overlay, CmdOptions &cmd_opti
 	if (config["tasks"])
 		tasklist = config_read_tasks(config);
 
+	// Arrival process for the tasks
+	if (config["arrivals"])
+		config_read_arrivals(config, tasklist);
+
+	// Read the processes to attach to
+	if (config["attach"])
+		attachlist = config_read_attach(config);
+
+	// Metrics computed from the counters
+	if (config["derived_metrics"])
+		derived = config_read_derived_metrics(config);
+
+	// Metrics whose quantiles are computed
+	if (config["quantiles"])
+		quantiles = config_read_quantiles(config);
+
+	// The tasks are either launched by us or attached, but not both
+	if (!tasklist.empty() && !attachlist.empty())
+		throw_with_trace(std::runtime_error("The config cannot have both 'tasks' and 'attach' sections"));
+
 	// Check that all COS (but 0) have cpus or tasks assigned
 	for (size_t i = 1; i < coslist.size(); i++)
 	{
@@ -22,7 +22,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <memory>
 #include <vector>
 
+#include "attach.hpp"
 #include "cat-policy.hpp"
+#include "derived-metrics.hpp"
+#include "quantile-sketch.hpp"
 #include "task.hpp"
 #include "sched.hpp"
 
@@ -44,7 +47,13 @@ struct CmdOptions
 		std::vector<std::string> event        = {"ref-cycles", "instructions"}; // Events to monitor
 		std::vector<uint32_t>    cpu_affinity = {}; // CPUs to pin the manager to
 		std::string              cat_impl     = "linux"; // Linux or Intel implementation
+		bool                     cat_verify   = false; // Check the cached CAT state against resctrl on every read
+		uint32_t                 collect_threads = 1; // Threads used to read and accumulate the counters of the tasks
+		bool                     pipeline     = false; // Print and apply the CAT policy concurrently with the next interval
+		std::string              pause_mode   = "signal"; // How to stop the tasks between intervals (signal, none or freezer)
+		bool                     async_output = false; // Write the output files from a separate thread
+		double                   output_flush = 1; // Max seconds the async output stays in memory before being written
 };
 
 
-void config_read(const std::string &path, const std::string &overlay, CmdOptions &cmd_options, tasklist_t &tasklist, std::vector<Cos> &coslist, std::shared_ptr<cat::policy::Base> &catpol, sched::ptr_t &sched);
+void config_read(const std::string &path, const std::string &overlay, CmdOptions &cmd_options, tasklist_t &tasklist, std::vector<AttachSpec> &attachlist, std::vector<Cos> &coslist, std::shared_ptr<cat::policy::Base> &catpol, sched::ptr_t &sched, std::vector<DerivedMetric> &derived, QuantileMetrics &quantiles);
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+#include <fmt/format.h>
+
+#include "derived-metrics.hpp"
+#include "stats.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+struct Expression::Parser
+{
+	Expression &e;
+	const std::string &s;
+	size_t pos = 0;
+	size_t depth = 0;     // Stack depth at the current point of the code
+	size_t max_depth = 0;
+
+	Parser(Expression &_e) : e(_e), s(_e.text) {}
+
+	[[noreturn]] void error(const std::string &msg) const
+	{
+		throw_with_trace(std::runtime_error("Error in the expression '{}' at position {}: {}"_format(s, pos, msg)));
+	}
+
+	void skip_spaces()
+	{
+		while (pos < s.size() && std::isspace(s[pos]))
+			pos++;
+	}
+
+	bool accept(char c)
+	{
+		skip_spaces();
+		if (pos < s.size() && s[pos] == c)
+		{
+			pos++;
+			return true;
+		}
+		return false;
+	}
+
+	void emit(Op op, double constant = 0, metric_t id = 0)
+	{
+		Instr instr;
+		instr.op = op;
+		instr.constant = constant;
+		instr.id = id;
+		e.code.push_back(instr);
+
+		// Operands push a value, binary operators pop two values and push one
+		if (op == Op::constant || op == Op::metric)
+			depth++;
+		else if (op != Op::neg)
+			depth--;
+		max_depth = std::max(max_depth, depth);
+	}
+
+	void metric(const std::string &name)
+	{
+		if (name.empty())
+			error("empty metric name");
+		metric_t id = Stats::metric(name);
+		if (std::find(e.operands.begin(), e.operands.end(), id) == e.operands.end())
+			e.operands.push_back(id);
+		emit(Op::metric, 0, id);
+	}
+
+	void primary()
+	{
+		skip_spaces();
+		if (pos >= s.size())
+			error("unexpected end");
+
+		char c = s[pos];
+		if (accept('('))
+		{
+			expr();
+			if (!accept(')'))
+				error("expected ')'");
+		}
+		else if (accept('{'))
+		{
+			size_t end = s.find('}', pos);
+			if (end == std::string::npos)
+				error("expected '}'");
+			metric(s.substr(pos, end - pos));
+			pos = end + 1;
+		}
+		else if (std::isdigit(c) || c == '.')
+		{
+			char *end;
+			double value = strtod(s.c_str() + pos, &end);
+			pos = end - s.c_str();
+			emit(Op::constant, value);
+		}
+		else if (std::isalpha(c) || c == '_')
+		{
+			size_t start = pos;
+			while (pos < s.size() && (std::isalnum(s[pos]) || s[pos] == '_' || s[pos] == '.' || s[pos] == ':'))
+				pos++;
+			metric(s.substr(start, pos - start));
+		}
+		else
+		{
+			error("unexpected character '{}'"_format(c));
+		}
+	}
+
+	void unary()
+	{
+		if (accept('-'))
+		{
+			unary();
+			emit(Op::neg);
+		}
+		else
+		{
+			primary();
+		}
+	}
+
+	void term()
+	{
+		unary();
+		while (true)
+		{
+			if (accept('*'))
+			{
+				unary();
+				emit(Op::mul);
+			}
+			else if (accept('/'))
+			{
+				unary();
+				emit(Op::div);
+			}
+			else
+				break;
+		}
+	}
+
+	void expr()
+	{
+		term();
+		while (true)
+		{
+			if (accept('+'))
+			{
+				term();
+				emit(Op::add);
+			}
+			else if (accept('-'))
+			{
+				term();
+				emit(Op::sub);
+			}
+			else
+				break;
+		}
+	}
+};
+
+
+Expression::Expression(const std::string &_text) : text(_text)
+{
+	Parser parser(*this);
+	parser.expr();
+	parser.skip_spaces();
+	if (parser.pos != text.size())
+		parser.error("unexpected '{}'"_format(text.substr(parser.pos)));
+	if (parser.max_depth > max_depth)
+		parser.error("too complex, it needs a stack of {} values"_format(parser.max_depth));
+}
+
+
+double Expression::eval(const std::vector<double> &values) const
+{
+	double stack[max_depth];
+	size_t top = 0;
+
+	for (const auto &instr : code)
+	{
+		switch (instr.op)
+		{
+			case Op::constant:
+				stack[top++] = instr.constant;
+				break;
+			case Op::metric:
+				stack[top++] = values[instr.id];
+				break;
+			case Op::add:
+				top--;
+				stack[top - 1] += stack[top];
+				break;
+			case Op::sub:
+				top--;
+				stack[top - 1] -= stack[top];
+				break;
+			case Op::mul:
+				top--;
+				stack[top - 1] *= stack[top];
+				break;
+			case Op::div:
+				top--;
+				stack[top - 1] /= stack[top];
+				break;
+			case Op::neg:
+				stack[top - 1] = -stack[top - 1];
+				break;
+		}
+	}
+	return stack[0];
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+typedef uint32_t metric_t;
+
+
+// Arithmetic expression over metrics, i.e. "mem_load_uops_retired.l3_miss * 1000 / instructions".
+// It is parsed once into a sequence of stack operations, evaluated with the values of the metrics
+// indexed by their handles. Metric names with characters that are also operators go between braces,
+// i.e. "instructions / {ref-cycles}".
+class Expression
+{
+	enum class Op {constant, metric, add, sub, mul, div, neg};
+
+	struct Instr
+	{
+		Op op;
+		double constant = 0;
+		metric_t id = 0;
+	};
+
+	static const size_t max_depth = 32;
+
+	std::string text;
+	std::vector<Instr> code;
+	std::vector<metric_t> operands; // Metrics used, without repetitions
+
+	// Recursive descent parser
+	struct Parser;
+
+	public:
+
+	Expression() = default;
+	Expression(const std::string &_text);
+
+	const std::string& get_text() const { return text; }
+	const std::vector<metric_t>& get_operands() const { return operands; }
+
+	// 'values' must have an entry for every operand
+	double eval(const std::vector<double> &values) const;
+};
+
+
+struct DerivedMetric
+{
+	std::string name;
+	Expression expr;
+	bool builtin = false; // Only computed if its operands are there, instead of being required
+
+	DerivedMetric() = default;
+	DerivedMetric(const std::string &_name, const std::string &_expr, bool _builtin = false) :
+			name(_name), expr(_expr), builtin(_builtin) {};
+};
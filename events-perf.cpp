@@ -16,6 +16,9 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cmath>
+#include <mutex>
+
 #include <fmt/format.h>
 
 extern "C"
@@ -32,41 +35,50 @@ extern "C"
 
 using fmt::literals::operator""_format;
 
-double read_energy_pkg();
-double read_energy_ram();
-
-
+// The perf code behind libminiperf keeps global state (i.e. the shadow stats updated when the
+// counters are processed), so reading counters from several threads has to be serialized
+static std::mutex miniperf_mutex;
 
-double get_clos_pid(pid_t pid,std::shared_ptr<CAT> cat);
-double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat);
-double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat);
 
-double get_clos_pid(pid_t pid,std::shared_ptr<CAT> cat)
+void Perf::init()
 {
-	auto ptr = std::dynamic_pointer_cast<CATLinux>(cat);
-	return (double) ptr->get_clos_of_task(pid);
+	rapl = std::make_unique<Rapl>();
+	initialized = true;
 }
 
-double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat)
+
+// Read the energy once per interval, all the tasks read the same values
+void Perf::sample_energy()
 {
-	auto ptr = std::dynamic_pointer_cast<CATLinux>(cat);
-	uint32_t clos = ptr->get_clos_of_task(pid);
-	//LOGINF("get_mask_pid : {:#x}"_format(ptr->get_cbm(clos)));
-	return (double) ptr->get_cbm(clos);
+	assert(initialized);
+	rapl->sample();
 }
 
-double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat)
+
+// Add the energy consumed since the last read by the package the task is in now
+void Perf::account_energy(EventDesc &desc, int cpu)
 {
-	auto ptr = std::dynamic_pointer_cast<CATLinux>(cat);
-	uint32_t clos = ptr->get_clos_of_task(pid);
-	uint64_t n = __builtin_popcount(ptr->get_cbm(clos));
-	//LOGINF("get_num_ways_pid : {}"_format(n));
-    return (double) n;
-}
+	if (!rapl)
+		return;
 
+	size_t n = rapl->get_num_packages();
+	bool first = desc.last_pkg_uj.empty();
+	desc.last_pkg_uj.resize(n);
+	desc.last_ram_uj.resize(n);
 
-void Perf::init()
-{}
+	int package = rapl->get_package(cpu);
+	if (!first && (size_t) package < n)
+	{
+		desc.pkg_uj += rapl->get_uj(Rapl::Kind::package, package) - desc.last_pkg_uj.at(package);
+		desc.ram_uj += rapl->get_uj(Rapl::Kind::dram, package) - desc.last_ram_uj.at(package);
+	}
+
+	for (size_t p = 0; p < n; p++)
+	{
+		desc.last_pkg_uj[p] = rapl->get_uj(Rapl::Kind::package, p);
+		desc.last_ram_uj[p] = rapl->get_uj(Rapl::Kind::dram, p);
+	}
+}
 
 
 void Perf::clean()
@@ -85,194 +97,150 @@ void Perf::clean(pid_t pid)
 }
 
 
-void Perf::setup_events(pid_t pid, const std::vector<std::string> &groups)
+// Counters added by us to the first group of every task
+static const std::vector<CounterInfo> extra_counters =
 {
-	assert(pid >= 1);
-	for (const auto &events : groups)
-	{
-		const auto evlist = ::setup_events(std::to_string(pid).c_str(), events.c_str());
-		if (evlist == NULL)
-			throw_with_trace(std::runtime_error("Could not setup events '{}'"_format(events)));
-		if (::num_entries(evlist) >= max_num_events)
-			throw_with_trace(std::runtime_error("Too many events"));
-		pid_events[pid].append(evlist);
-		::enable_counters(evlist);
-	}
-}
+	{"power/energy-pkg/", "j", false},
+	{"power/energy-ram/", "j", false},
+	// LUCIA add entries for CLOS and CAT info
+	{"clos_num", "", true},
+	{"num_ways", "", true},
+	{"clos_mask", "", true},
+};
+enum {extra_epkg, extra_eram, extra_closnum, extra_numways, extra_maskhex};
 
 
-void Perf::enable_counters(pid_t pid)
+int CounterSnapshot::find(const std::string &name) const
 {
-	for (const auto &evlist : pid_events[pid].groups)
-		::enable_counters(evlist);
+	for (size_t i = 0; i < size(); i++)
+		if (info(i).name == name)
+			return i;
+	return -1;
 }
 
 
-void Perf::disable_counters(pid_t pid)
+void CounterSnapshot::assign(const CounterSnapshot &other)
 {
-	for (const auto &evlist : pid_events[pid].groups)
-		::disable_counters(evlist);
+	// Vectors keep their capacity when assigned, so after the first time this does not allocate
+	table = other.table;
+	values = other.values;
+	enabled = other.enabled;
+	running = other.running;
 }
 
 
-uint64_t read_max_ujoules_ram()
+void CounterSnapshot::clear()
 {
-	// TODO: This needs improvement... i.e. consider more packages etc.
-	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/max_energy_range_uj");
-	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/name");
-	uint64_t data;
-
-	fdata >> data;
-
-	std::string name;
-	fname >> name;
-
-	assert(name == "dram");
-
-	return data;
+	values.clear();
+	enabled.clear();
+	running.clear();
 }
 
 
-uint64_t read_max_ujoules_pkg()
+void Perf::setup_events(pid_t pid, const std::vector<std::string> &groups)
 {
-	// TODO: This needs improvement... i.e. consider more packages etc.
-	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/max_energy_range_uj");
-	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/name");
-	uint64_t data;
+	const char *names[max_num_events];
+	const char *units[max_num_events];
+	bool snapshot[max_num_events];
 
-	fdata >> data;
+	assert(pid >= 1);
+	for (const auto &events : groups)
+	{
+		const auto evlist = ::setup_events(std::to_string(pid).c_str(), events.c_str());
+		if (evlist == NULL)
+			throw_with_trace(std::runtime_error("Could not setup events '{}'"_format(events)));
+		int n = ::num_entries(evlist);
+		if (n >= max_num_events)
+			throw_with_trace(std::runtime_error("Too many events"));
 
-	std::string name;
-	fname >> name;
+		// Resolve the properties of the counters now, they are not needed when reading them
+		::read_counters(evlist, names, NULL, units, snapshot, NULL, NULL);
+		auto table = std::make_shared<std::vector<CounterInfo>>();
+		for (int i = 0; i < n; i++)
+			table->emplace_back(names[i], units[i] ? units[i] : "", snapshot[i]);
 
-	assert(name == "package-0");
+		// Put energy measurements only in the first group
+		if (pid_events[pid].groups.empty())
+			table->insert(table->end(), extra_counters.begin(), extra_counters.end());
 
-	return data;
+		pid_events[pid].append(evlist, table);
+		::enable_counters(evlist);
+	}
+	account_energy(pid_events[pid], -1);
 }
 
 
-double read_energy_ram()
+void Perf::enable_counters(pid_t pid)
 {
-	// TODO: This needs improvement... i.e. consider more packages etc.
-	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/energy_uj");
-	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/intel-rapl:0:0/name");
-	uint64_t data;
-
-	fdata >> data;
-
-	std::string name;
-	fname >> name;
-
-	LOGDEB("RAM energy: " << data);
-
-	assert(name == "dram");
-
-	return (double) data / 1E6; // Convert it to joules
+	for (const auto &evlist : pid_events[pid].groups)
+		::enable_counters(evlist);
 }
 
 
-double read_energy_pkg()
+void Perf::disable_counters(pid_t pid)
 {
-	// TODO: This needs improvement... i.e. consider more packages etc.
-	auto fdata = open_ifstream("/sys/class/powercap/intel-rapl:0/energy_uj");
-	auto fname = open_ifstream("/sys/class/powercap/intel-rapl:0/name");
-	uint64_t data;
-
-	fdata >> data;
-
-	std::string name;
-	fname >> name;
-
-	LOGDEB("PKG energy: " << data);
-
-	assert(name == "package-0");
-
-	return (double) data / 1E6; // Convert it to joules
+	for (const auto &evlist : pid_events[pid].groups)
+		::disable_counters(evlist);
 }
 
 
-
-
-std::vector<counters_t> Perf::read_counters(pid_t pid,std::shared_ptr<CAT> cat)
+const std::vector<CounterSnapshot>& Perf::read_counters(pid_t pid, std::shared_ptr<CAT> cat, int cpu)
 {
-	const char *names[max_num_events];
-	double results[max_num_events];
-	const char *units[max_num_events];
-	bool snapshot[max_num_events];
-	uint64_t enabled[max_num_events];
-	uint64_t running[max_num_events];
-
-	const auto epkg = "power/energy-pkg/";
-	const auto eram = "power/energy-ram/";
-	// LUCIA add entries for CLOS and CAT info
-    const auto closnum = "clos_num";
-    const auto numways = "num_ways";
-    const auto maskhex = "clos_mask";
+	// Only this task's entry is modified, so tasks can be read in parallel
+	auto &desc = pid_events.at(pid);
+	account_energy(desc, cpu);
 
-	auto result = std::vector<counters_t>();
-
-	bool first = true;
-	for (const auto &evlist : pid_events[pid].groups)
+	for (size_t g = 0; g < desc.groups.size(); g++)
 	{
-		int n = ::num_entries(evlist);
-		auto counters = counters_t();
-		::read_counters(evlist, names, results, units, snapshot, enabled, running);
-		int i;
-		for (i = 0; i < n; i++)
+		auto &snapshot = desc.snapshots[g];
+		int n = ::num_entries(desc.groups[g]);
 		{
-			assert(running[i] <= enabled[i]);
-			counters.insert({i, names[i], results[i], units[i], snapshot[i], enabled[i], running[i]});
+			std::lock_guard<std::mutex> lock(miniperf_mutex);
+			::read_counters(desc.groups[g], NULL, snapshot.values.data(), NULL, NULL, snapshot.enabled.data(), snapshot.running.data());
 		}
-		// Put energy measurements only in the first group
-		if (first)
+		for (int i = 0; i < n; i++)
+			assert(snapshot.running[i] <= snapshot.enabled[i]);
+
+		// Energy measurements are only in the first group
+		if (g == 0)
 		{
-			counters.insert({i++, epkg, read_energy_pkg(), "j", false, 1, 1});
-			counters.insert({i++, eram, read_energy_ram(), "j", false, 1, 1});
-			// LUCIA put values
-			counters.insert({i++, closnum, get_clos_pid(pid,cat), "", true, 1, 1});
-			counters.insert({i++, maskhex, get_mask_pid(pid,cat), "", true, 1, 1});
-			counters.insert({i++, numways, get_num_ways_pid(pid,cat), "", true, 1, 1});
-
-			first = false;
+			snapshot.values[n + extra_epkg] = (double) desc.pkg_uj / 1E6;
+			snapshot.values[n + extra_eram] = (double) desc.ram_uj / 1E6;
+			// CLOS of the task, looked up once for the three values
+			const auto *cat_linux = dynamic_cast<const CATLinux *>(cat.get());
+			if (cat_linux)
+			{
+				uint32_t clos = cat_linux->get_clos_of_task(pid);
+				uint64_t cbm = cat_linux->get_cbm(clos);
+				snapshot.values[n + extra_closnum] = clos;
+				snapshot.values[n + extra_numways] = __builtin_popcountll(cbm);
+				snapshot.values[n + extra_maskhex] = cbm;
+			}
+			else
+			{
+				snapshot.values[n + extra_closnum] = NAN;
+				snapshot.values[n + extra_numways] = NAN;
+				snapshot.values[n + extra_maskhex] = NAN;
+			}
+			for (size_t i = n; i < snapshot.size(); i++)
+			{
+				snapshot.enabled[i] = 1;
+				snapshot.running[i] = 1;
+			}
 		}
-		result.push_back(counters);
 	}
-	return result;
+	return desc.snapshots;
 }
 
 
 std::vector<std::vector<std::string>> Perf::get_names(pid_t pid)
 {
-	const char *names[max_num_events];
 	auto r = std::vector<std::vector<std::string>>();
-
-	const auto epkg = "power/energy-pkg/";
-	const auto eram = "power/energy-ram/";
-
-	// LUCIA add entries for CLOS and CAT info
-	const auto closnum = "clos_num";
-	const auto numways = "num_ways";
-	const auto maskhex = "clos_mask";
-
-	bool first = true;
-	for (const auto &evlist : pid_events[pid].groups)
+	for (const auto &snapshot : pid_events.at(pid).snapshots)
 	{
-		int n = ::num_entries(evlist);
 		auto v = std::vector<std::string>();
-		::get_names(evlist, names);
-		for (int i = 0; i < n; i++)
-			v.push_back(names[i]);
-		// Put energy measurements only in the first group
-		if (first)
-		{
-			v.push_back(epkg);
-			v.push_back(eram);
-			//LUCIA add CLOS fields
-			v.push_back(closnum);
-			v.push_back(numways);
-			v.push_back(maskhex);
-			first = false;
-		}
+		for (const auto &info : *snapshot.table)
+			v.push_back(info.name);
 		r.push_back(v);
 	}
 	return r;
@@ -20,60 +20,55 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 #include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/identity.hpp>
-#include <boost/multi_index/member.hpp>
 #include "cat-linux.hpp"
 #include "common.hpp"
+#include "rapl.hpp"
 #include "throw-with-trace.hpp"
 
 
-namespace mi = boost::multi_index;
-
-double get_clos_pid(pid_t pid,std::shared_ptr<CAT> cat);
-double get_mask_pid(pid_t pid,std::shared_ptr<CAT> cat);
-double get_num_ways_pid(pid_t pid,std::shared_ptr<CAT> cat);
-
 struct perf_evlist;
 
-struct Counter
+// Properties of a counter, resolved once when the events are setup
+struct CounterInfo
 {
-	int id = 0;
-	std::string name = "";
-	double value = 0;
-	std::string unit = "";
+	std::string name;
+	std::string unit;
 	bool snapshot = false;
-	uint64_t enabled = 0;
-	uint64_t running = 0;
 
-	Counter() = default;
-	Counter(int _id, const std::string &_name, double _value, const std::string &_unit, bool _snapshot, uint64_t _enabled, uint64_t _running) :
-			id(_id), name(_name), value(_value), unit(_unit), snapshot(_snapshot), enabled(_enabled), running(_running) {};
-	bool operator<(const Counter &c) const {return id < c.id;}
+	CounterInfo() = default;
+	CounterInfo(const std::string &_name, const std::string &_unit, bool _snapshot) :
+			name(_name), unit(_unit), snapshot(_snapshot) {};
 };
+typedef std::shared_ptr<const std::vector<CounterInfo>> counter_table_t;
+
+// Values of the counters of a group at some point in time. Counters are addressed by their position,
+// the same one they have in the table, which is shared by all the snapshots of the group.
+struct CounterSnapshot
+{
+	counter_table_t table;
+	std::vector<double> values;
+	std::vector<uint64_t> enabled;
+	std::vector<uint64_t> running;
+
+	CounterSnapshot() = default;
+	CounterSnapshot(const counter_table_t &_table) :
+			table(_table), values(_table->size()), enabled(_table->size()), running(_table->size()) {};
+
+	size_t size() const { return values.size(); }
+	bool empty() const { return values.empty(); }
+	const CounterInfo &info(size_t i) const { return (*table)[i]; }
 
-struct by_id {};
-struct by_name {};
-typedef mi::multi_index_container<
-	Counter,
-	mi::indexed_by<
-		// sort by Counter::operator<
-		mi::ordered_unique<mi::tag<by_id>, mi::identity<Counter> >,
-
-		// sort by less<string> on name
-		mi::ordered_unique<
-			mi::tag<by_name>,
-			mi::member<
-				Counter,
-				std::string,
-				&Counter::name
-			>
-		>
-	>
-> counters_t;
+	// Position of a counter, or -1 if it is not in the snapshot
+	int find(const std::string &name) const;
+
+	// Copy the values of another snapshot of the same group, without allocating memory
+	void assign(const CounterSnapshot &other);
+	void clear();
+};
 
 
 class Perf
@@ -83,16 +78,28 @@ class Perf
 	struct EventDesc
 	{
 		std::vector<struct perf_evlist*> groups;
+		std::vector<CounterSnapshot> snapshots; // Where the groups are read, reused every time
+
+		// Energy attributed to the task, from the package it runs on
+		std::vector<uint64_t> last_pkg_uj; // Energy of every package at the last read
+		std::vector<uint64_t> last_ram_uj;
+		uint64_t pkg_uj = 0;
+		uint64_t ram_uj = 0;
 
 		EventDesc() = default;
-		EventDesc(const std::vector<struct perf_evlist*> &_groups) :
-				groups(_groups) {};
-		void append(struct perf_evlist *ev_list) { groups.push_back(ev_list); }
+		void append(struct perf_evlist *ev_list, const counter_table_t &table)
+		{
+			groups.push_back(ev_list);
+			snapshots.emplace_back(table);
+		}
 	};
 
 	std::map<pid_t, EventDesc> pid_events;
+	rapl_ptr_t rapl;
 	bool initialized = false;
 
+	void account_energy(EventDesc &desc, int cpu);
+
 	public:
 
 	Perf() = default;
@@ -110,9 +117,12 @@ class Perf
 
 	void init();
 	void clean();
+	void sample_energy();
 	void clean(pid_t pid);
 	void setup_events(pid_t pid, const std::vector<std::string> &groups);
-	std::vector<counters_t> read_counters(pid_t pid,std::shared_ptr<CAT> cat);
+	// The energy since the previous read is attributed to the package of 'cpu'.
+	// The snapshots are overwritten by the next read of the same task.
+	const std::vector<CounterSnapshot>& read_counters(pid_t pid, std::shared_ptr<CAT> cat, int cpu = -1);
 	std::vector<std::vector<std::string>> get_names(pid_t pid);
 	void enable_counters(pid_t pid);
 	void disable_counters(pid_t pid);
@@ -120,7 +130,3 @@ class Perf
 };
 
 
-uint64_t read_max_ujoules_ram();
-uint64_t read_max_ujoules_pkg();
-
-
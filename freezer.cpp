@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "freezer.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using std::string;
+using fmt::literals::operator""_format;
+
+
+static
+int open_cgroup_file(const fs::path &path, int flags)
+{
+	int fd = open(path.c_str(), flags | O_CLOEXEC);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Could not open '{}': {}"_format(path.string(), strerror(errno))));
+	return fd;
+}
+
+
+Freezer::Freezer(const string &name, const string &_mountpoint) : mountpoint(_mountpoint), root(mountpoint / name)
+{
+	if (!fs::exists(mountpoint / "cgroup.controllers"))
+		throw_with_trace(std::runtime_error("There is no cgroup v2 hierarchy mounted in '{}'"_format(mountpoint.string())));
+
+	// In the unified hierarchy there is a single line with the format '0::/path'
+	std::ifstream f = open_ifstream("/proc/self/cgroup");
+	string line;
+	while (std::getline(f, line))
+		if (line.compare(0, 3, "0::") == 0)
+			origin = mountpoint / line.substr(3);
+	if (origin.empty())
+		throw_with_trace(std::runtime_error("Could not find the cgroup v2 of the manager"));
+
+	if (fs::exists(root))
+		throw_with_trace(std::runtime_error("Cannot create cgroup: directory {} already exists"_format(root.string())));
+	fs::create_directory(root);
+
+	inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if (inotify_fd < 0)
+		throw_with_trace(std::runtime_error("Could not create inotify instance: {}"_format(strerror(errno))));
+
+	LOGINF("Using the cgroup freezer in '{}'"_format(root.string()));
+}
+
+
+Freezer::~Freezer()
+{
+	for (const auto &item : groups)
+	{
+		close(item.second.freeze_fd);
+		close(item.second.events_fd);
+	}
+	if (inotify_fd >= 0)
+		close(inotify_fd);
+}
+
+
+Freezer::Group& Freezer::get_group(const Task &task)
+{
+	auto it = groups.find(task.id);
+	if (it == groups.end())
+		throw_with_trace(std::runtime_error("Task {}:{} is not in the freezer"_format(task.id, task.name)));
+	return it->second;
+}
+
+
+void Freezer::attach(const Task &task)
+{
+	auto it = groups.find(task.id);
+	if (it == groups.end())
+	{
+		Group group;
+		group.dir = root / "{}-{}"_format(task.id, task.name);
+		if (!fs::exists(group.dir))
+			fs::create_directory(group.dir);
+		group.freeze_fd = open_cgroup_file(group.dir / "cgroup.freeze", O_WRONLY);
+		group.events_fd = open_cgroup_file(group.dir / "cgroup.events", O_RDONLY);
+
+		// cgroup.events generates a modification event every time its contents change
+		if (inotify_add_watch(inotify_fd, (group.dir / "cgroup.events").c_str(), IN_MODIFY) < 0)
+			throw_with_trace(std::runtime_error("Could not watch '{}/cgroup.events': {}"_format(group.dir.string(), strerror(errno))));
+
+		it = groups.emplace(task.id, group).first;
+	}
+
+	try
+	{
+		std::ofstream f = open_ofstream(it->second.dir / "cgroup.procs");
+		f << task.pid << std::endl;
+		auto children = std::vector<pid_t>();
+		pid_get_children_rec(task.pid, children);
+		for (const auto &child_pid : children)
+			f << child_pid << std::endl;
+	}
+	catch(const std::system_error &e)
+	{
+		throw_with_trace(std::runtime_error("Cannot write pid '{}' into '{}'"_format(task.pid, (it->second.dir / "cgroup.procs").string())));
+	}
+}
+
+
+void Freezer::adopt(const tasklist_t &tasklist)
+{
+	for (const auto &task : tasklist)
+		attach(*task);
+	freeze(tasklist);
+
+	// A frozen task does not run even after being sent SIGCONT
+	tasks_resume(tasklist);
+}
+
+
+bool Freezer::is_frozen(const Group &group) const
+{
+	char buf[256];
+	ssize_t n = pread(group.events_fd, buf, sizeof(buf) - 1, 0);
+	if (n < 0)
+		throw_with_trace(std::runtime_error("Could not read '{}/cgroup.events': {}"_format(group.dir.string(), strerror(errno))));
+	buf[n] = '\0';
+
+	const char *frozen = strstr(buf, "frozen ");
+	if (!frozen)
+		throw_with_trace(std::runtime_error("No frozen state in '{}/cgroup.events'"_format(group.dir.string())));
+	return frozen[strlen("frozen ")] == '1';
+}
+
+
+void Freezer::set_frozen(const tasklist_t &tasklist, bool frozen)
+{
+	const char *value = frozen ? "1" : "0";
+	for (const auto &task : tasklist)
+	{
+		const auto &group = get_group(*task);
+		if (pwrite(group.freeze_fd, value, 1, 0) != 1)
+			throw_with_trace(std::runtime_error("Could not write '{}/cgroup.freeze': {}"_format(group.dir.string(), strerror(errno))));
+	}
+}
+
+
+// Wait for all the cgroups to reach the desired state. Writes to cgroup.freeze return immediately,
+// so we sleep on the modification events of cgroup.events instead of polling each task.
+void Freezer::wait(const tasklist_t &tasklist, bool frozen)
+{
+	auto pending = std::vector<const Group *>();
+	for (const auto &task : tasklist)
+		pending.push_back(&get_group(*task));
+
+	const auto start = std::chrono::steady_clock::now();
+	while (true)
+	{
+		pending.erase(std::remove_if(pending.begin(), pending.end(),
+				[this, frozen](const Group *g) { return is_frozen(*g) == frozen; }), pending.end());
+		if (pending.empty())
+			return;
+
+		struct pollfd pfd = {inotify_fd, POLLIN, 0};
+		int ret = poll(&pfd, 1, 1000);
+		if (ret < 0 && errno != EINTR)
+			throw_with_trace(std::runtime_error("Error waiting for the freezer: {}"_format(strerror(errno))));
+		if (ret == 0)
+		{
+			auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
+			LOGWAR("Still waiting for {} cgroup(s) to be {} after {} s"_format(pending.size(), frozen ? "frozen" : "thawed", elapsed.count()));
+		}
+
+		// Drain the events, we only care about having been woken up
+		char buf[4096];
+		while (read(inotify_fd, buf, sizeof(buf)) > 0) {}
+	}
+}
+
+
+void Freezer::freeze(const tasklist_t &tasklist)
+{
+	set_frozen(tasklist, true);
+	wait(tasklist, true);
+}
+
+
+void Freezer::thaw(const tasklist_t &tasklist)
+{
+	set_frozen(tasklist, false);
+	wait(tasklist, false);
+}
+
+
+void Freezer::clean()
+{
+	// Exiting processes can take a moment to leave their cgroup
+	auto remove = [](const fs::path &dir)
+	{
+		for (int i = 0; i < 100; i++)
+		{
+			if (rmdir(dir.c_str()) == 0 || errno == ENOENT)
+				return;
+			if (errno != EBUSY)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		LOGERR("Could not remove cgroup '{}': {}"_format(dir.string(), strerror(errno)));
+	};
+
+	for (const auto &item : groups)
+	{
+		const auto &group = item.second;
+		if (pwrite(group.freeze_fd, "0", 1, 0) != 1)
+			LOGERR("Could not thaw cgroup '{}': {}"_format(group.dir.string(), strerror(errno)));
+
+		// Processes have to be written one by one
+		try
+		{
+			std::ifstream in = open_ifstream(group.dir / "cgroup.procs");
+			pid_t pid;
+			while (in >> pid)
+			{
+				std::ofstream out = open_ofstream(origin / "cgroup.procs");
+				out << pid << std::endl;
+			}
+		}
+		catch (const std::exception &e)
+		{
+			LOGERR("Could not move the processes out of cgroup '{}': {}"_format(group.dir.string(), e.what()));
+		}
+
+		remove(group.dir);
+	}
+	remove(root);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "task.hpp"
+
+
+// Pauses and resumes tasks in bulk using the cgroup v2 freezer.
+// Every task gets its own cgroup inside an experiment cgroup, so its descendants are frozen too.
+class Freezer
+{
+	struct Group
+	{
+		boost::filesystem::path dir;
+		int freeze_fd = -1; // cgroup.freeze
+		int events_fd = -1; // cgroup.events
+	};
+
+	const boost::filesystem::path mountpoint;
+	const boost::filesystem::path root; // Experiment cgroup
+	boost::filesystem::path origin;     // Cgroup of the manager, where the tasks start
+	std::map<uint32_t, Group> groups;   // By task id
+	int inotify_fd = -1;
+
+	Group& get_group(const Task &task);
+	bool is_frozen(const Group &group) const;
+	void set_frozen(const tasklist_t &tasklist, bool frozen);
+	void wait(const tasklist_t &tasklist, bool frozen);
+
+	public:
+
+	Freezer() = delete;
+	Freezer(const std::string &name, const std::string &mountpoint = "/sys/fs/cgroup");
+	~Freezer();
+
+	Freezer(const Freezer&) = delete;
+	Freezer& operator=(const Freezer&) = delete;
+
+	// Move the task and its current descendants to the cgroup of the task, creating it if needed
+	void attach(const Task &task);
+
+	// Take stopped tasks, as left by task_execute, and leave them frozen instead
+	void adopt(const tasklist_t &tasklist);
+
+	// Freeze or thaw the tasks and wait until the kernel reports that they are done
+	void freeze(const tasklist_t &tasklist);
+	void thaw(const tasklist_t &tasklist);
+
+	// Thaw the tasks, move them back to the cgroup of the manager and remove the cgroups
+	void clean();
+};
+typedef std::shared_ptr<Freezer> freezer_ptr_t;
@@ -0,0 +1,139 @@
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "instr-limit.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+static
+int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+
+static
+sigset_t sigchld_set()
+{
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	return mask;
+}
+
+
+void InstrLimiter::block_sigchld()
+{
+	sigset_t mask = sigchld_set();
+	if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0)
+		throw_with_trace(std::runtime_error("Could not block SIGCHLD"));
+}
+
+
+InstrLimiter::InstrLimiter()
+{
+	sigset_t mask = sigchld_set();
+	signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (signal_fd < 0)
+		throw_with_trace(std::runtime_error("Could not create signalfd: {}"_format(strerror(errno))));
+}
+
+
+InstrLimiter::~InstrLimiter()
+{
+	for (const auto &item : armed)
+		close(item.second.fd);
+	if (signal_fd >= 0)
+		close(signal_fd);
+}
+
+
+void InstrLimiter::arm(const Task &task)
+{
+	assert(!task.attached);
+	disarm(task);
+
+	if (!task.max_instr)
+		return;
+
+	const double current = task.stats.get_current("instructions");
+	if (current >= task.max_instr)
+		return;
+	const uint64_t remaining = task.max_instr - current;
+
+	// Only the task itself, the overflow signal can only target one process
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.sample_period = remaining;
+	attr.wakeup_events = 1;
+	attr.disabled = 1;
+
+	int fd = perf_event_open(&attr, task.pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Task {}:{}: could not open the instructions limit counter: {}"_format(task.id, task.name, strerror(errno))));
+
+	// Deliver SIGSTOP to the task on overflow. REFRESH enables the counter for a single overflow.
+	if (fcntl(fd, F_SETFL, O_ASYNC) < 0 ||
+			fcntl(fd, F_SETSIG, SIGSTOP) < 0 ||
+			fcntl(fd, F_SETOWN, task.pid) < 0 ||
+			ioctl(fd, PERF_EVENT_IOC_REFRESH, 1) < 0)
+	{
+		int err = errno;
+		close(fd);
+		throw_with_trace(std::runtime_error("Task {}:{}: could not arm the instructions limit counter: {}"_format(task.id, task.name, strerror(err))));
+	}
+
+	armed[task.id] = Armed{fd, task.pid, remaining};
+	LOGDEB("Task {}:{} will be stopped in {} instructions"_format(task.id, task.name, remaining));
+}
+
+
+void InstrLimiter::disarm(const Task &task)
+{
+	auto it = armed.find(task.id);
+	if (it == armed.end())
+		return;
+	close(it->second.fd);
+	armed.erase(it);
+}
+
+
+tasklist_t InstrLimiter::reached(const tasklist_t &tasklist)
+{
+	// Several SIGCHLDs can be merged into one, so they only tell us that we have to look
+	struct signalfd_siginfo info;
+	while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {}
+
+	auto result = tasklist_t();
+	for (const auto &task : tasklist)
+	{
+		auto it = armed.find(task->id);
+		if (it == armed.end() || it->second.pid != task->pid)
+			continue;
+
+		uint64_t count = 0;
+		if (read(it->second.fd, &count, sizeof(count)) != sizeof(count))
+			throw_with_trace(std::runtime_error("Task {}:{}: could not read the instructions limit counter: {}"_format(task->id, task->name, strerror(errno))));
+		if (count >= it->second.period)
+			result.push_back(task);
+	}
+	return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <memory>
+
+#include "task.hpp"
+
+
+// Stops the tasks right when they reach their instruction limit, instead of at the end of the interval.
+//
+// Each task gets an instructions counter whose sample period is its remaining budget. On overflow the
+// kernel sends SIGSTOP to the task itself (O_ASYNC with F_SETSIG), so it stops within a few instructions
+// of the limit. The manager learns about it through the SIGCHLD of the stop, read from a signalfd.
+//
+// SIGCHLD must be blocked in every thread of the manager (see 'block_sigchld') for the signalfd to get it.
+// Only tasks launched by the manager can be limited this way, attached processes are not our children.
+class InstrLimiter
+{
+	struct Armed
+	{
+		int fd;
+		pid_t pid;
+		uint64_t period;
+	};
+
+	int signal_fd = -1;
+	std::map<uint32_t, Armed> armed; // By task id
+
+	public:
+
+	InstrLimiter();
+	~InstrLimiter();
+
+	InstrLimiter(const InstrLimiter&) = delete;
+	InstrLimiter& operator=(const InstrLimiter&) = delete;
+
+	// Call before creating any thread, the mask is inherited
+	static void block_sigchld();
+
+	// Readable when some child has changed its state
+	int get_fd() const { return signal_fd; }
+
+	// Start counting the instructions the task has left before reaching its limit
+	void arm(const Task &task);
+	void disarm(const Task &task);
+
+	// Consume the pending SIGCHLDs and return the tasks that have been stopped by their counter
+	tasklist_t reached(const tasklist_t &tasklist);
+};
+typedef std::shared_ptr<InstrLimiter> limiter_ptr_t;
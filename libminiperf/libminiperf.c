@@ -1,6 +1,9 @@
+#include <unistd.h>
+
 #include <linux/time64.h>
 
 #include "util/drv_configs.h"
+#include "util/pmu.h"
 #include "util/stat.h"
 #include "util/thread_map.h"
 
@@ -30,6 +33,13 @@ static int create_perf_stat_counter(struct perf_evlist *evsel_list, struct perf_
 	attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
 				    PERF_FORMAT_TOTAL_TIME_RUNNING;
 
+	/*
+	 * Group leaders return the values of all the members of the group with
+	 * a single read, see read_group. Requires Linux >= 4.3 for inherited events.
+	 */
+	if (perf_evsel__is_group_leader(evsel))
+		attr->read_format |= PERF_FORMAT_GROUP;
+
 	attr->inherit = true;
 
 	/*
@@ -73,24 +83,120 @@ static int create_perf_stat_counter(struct perf_evlist *evsel_list, struct perf_
 }
 
 
+static int open_counters(struct perf_evlist *evsel_list, struct target *target)
+{
+	struct perf_evsel *counter;
+	evlist__for_each_entry(evsel_list, counter)
+	{
+		if (create_perf_stat_counter(evsel_list, counter, target) < 0)
+			return -1;
+		counter->supported = true;
+	}
+	return 0;
+}
+
+
+static bool is_core_event(struct perf_evsel *evsel, struct perf_pmu *cpu_pmu)
+{
+	__u32 type = evsel->attr.type;
+	return type == PERF_TYPE_HARDWARE || type == PERF_TYPE_HW_CACHE || type == PERF_TYPE_RAW ||
+			(cpu_pmu && type == cpu_pmu->type);
+}
+
+
+/*
+ * Put every run of consecutive core PMU events in a group. The order of the
+ * events does not change, and the rest of the events (i.e. uncore, RDT or
+ * software ones) stay on their own, as the kernel does not mix hardware PMUs
+ * in a group. Returns the number of groups with more than one event.
+ */
+static int group_core_events(struct perf_evlist *evsel_list)
+{
+	struct perf_pmu *cpu_pmu = perf_pmu__find("cpu");
+	struct perf_evsel *counter, *leader = NULL;
+
+	evlist__for_each_entry(evsel_list, counter)
+	{
+		if (!is_core_event(counter, cpu_pmu))
+		{
+			leader = NULL;
+			continue;
+		}
+		if (!leader)
+		{
+			leader = counter;
+			continue;
+		}
+		counter->leader = leader;
+		leader->nr_members = counter->idx - leader->idx + 1;
+		if (leader->nr_members == 2)
+			evsel_list->nr_groups++;
+	}
+	return evsel_list->nr_groups;
+}
+
+
+/* Undo group_core_events, every event is its own leader */
+static void ungroup(struct perf_evlist *evsel_list)
+{
+	struct perf_evsel *counter;
+	evlist__for_each_entry(evsel_list, counter)
+	{
+		counter->leader = counter;
+		counter->nr_members = 0;
+	}
+	evsel_list->nr_groups = 0;
+}
+
+
 /*
- * Read out the results of a single counter
+ * Read out the results of a whole group with one syscall per cpu and thread.
+ * With PERF_FORMAT_GROUP the leader returns:
+ *
+ *	{ u64 nr; u64 time_enabled; u64 time_running; u64 values[nr]; }
+ *
+ * with the value of the leader first, followed by the members in the order
+ * they were added to the group. All of them share the enabled/running times.
  */
-static int read_counter(struct perf_evlist *evsel_list, struct perf_evsel *counter)
+static int read_group(struct perf_evlist *evsel_list, struct perf_evsel *leader)
 {
 	int nthreads = thread_map__nr(evsel_list->threads);
-	int ncpus = perf_evsel__nr_cpus(counter);
+	int ncpus = perf_evsel__nr_cpus(leader);
+	struct perf_evsel *pos;
+	int nr = 1;
 
-	if (!counter->supported)
+	if (!leader->supported)
 		return -ENOENT;
 
+	for_each_group_member(pos, leader)
+		nr++;
+
+	u64 buf[3 + nr];
+	ssize_t size = (3 + nr) * sizeof(u64);
+
 	for (int thread = 0; thread < nthreads; thread++)
 	{
 		for (int cpu = 0; cpu < ncpus; cpu++)
 		{
-			struct perf_counts_values *count = perf_counts(counter->counts, cpu, thread);
-			if (perf_evsel__read(counter, cpu, thread, count))
+			int fd = *(int *) xyarray__entry(leader->fd, cpu, thread);
+			if (read(fd, buf, size) != size || buf[0] != (u64) nr)
 				return -1;
+
+			u64 ena = buf[1], run = buf[2];
+			int i = 0;
+
+			struct perf_counts_values *count = perf_counts(leader->counts, cpu, thread);
+			count->val = buf[3 + i++];
+			count->ena = ena;
+			count->run = run;
+
+			for_each_group_member(pos, leader)
+			{
+				count = perf_counts(pos->counts, cpu, thread);
+				count->val = buf[3 + i++];
+				count->ena = ena;
+				count->run = run;
+			}
 		}
 	}
 
@@ -107,11 +213,15 @@ void read_counters(struct perf_evlist *evsel_list, const char **names, double *r
 		.scale		= true,
 	};
 
+	// Members are read together with their leader
 	evlist__for_each_entry(evsel_list, counter)
 	{
-		if (read_counter(evsel_list, counter))
-			fprintf(stderr, "failed to read counter %s\n", counter->name);
+		if (perf_evsel__is_group_leader(counter) && read_group(evsel_list, counter))
+			fprintf(stderr, "failed to read group %s\n", counter->name);
+	}
 
+	evlist__for_each_entry(evsel_list, counter)
+	{
 		if (perf_stat_process_counter(&stat_config, counter))
 			fprintf(stderr, "failed to process counter %s\n", counter->name);
 	}
@@ -214,7 +324,6 @@ void print_counters2(struct perf_evlist *evsel_list, struct timespec *ts)
 struct perf_evlist* setup_events(const char *pid, const char *events)
 {
 	struct perf_evlist	*evsel_list = NULL;
-	bool group = false;
 
 	struct target target = {
 		.uid	= UINT_MAX,
@@ -243,18 +352,26 @@ struct perf_evlist* setup_events(const char *pid, const char *events)
 	if (perf_evlist__alloc_stats(evsel_list, true))
 		goto out;
 
-	if (group)
-		perf_evlist__set_leader(evsel_list);
-
+	/*
+	 * Without explicit groups (braces), the core events are grouped, so they
+	 * are read with one syscall. The kernel refuses to open a group that does
+	 * not fit in the PMU, in that case every event is opened on its own.
+	 */
+	bool group = !evsel_list->nr_groups && group_core_events(evsel_list);
 
-	struct perf_evsel *counter;
-	evlist__for_each_entry(evsel_list, counter)
+	if (open_counters(evsel_list, &target) < 0)
 	{
-		if (create_perf_stat_counter(evsel_list, counter, &target) < 0)
+		if (!group)
+			exit(-1);
+		fprintf(stderr, "could not open '%s' as a group, opening the events separately\n", events);
+		perf_evlist__close(evsel_list);
+		ungroup(evsel_list);
+		if (open_counters(evsel_list, &target) < 0)
 			exit(-1);
-		counter->supported = true;
 	}
 
+	struct perf_evsel *counter;
+
 	if (perf_evlist__apply_filters(evsel_list, &counter))
 	{
 		error("failed to set filter \"%s\" on event %s with %d (%s)\n",
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "live-stats.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The live stats are written in the native byte order, which must be little-endian");
+
+
+// Fixed part of a task record, before the values
+struct TaskRecord
+{
+	uint32_t id;
+	int32_t pid;
+	int32_t cpu;
+	uint32_t reserved;
+	char name[live::name_size];
+};
+
+
+LiveStats::LiveStats(const std::string &_name, uint32_t _num_clos) : name(_name), num_clos(_num_clos), new_masks(_num_clos)
+{
+	if (name.empty() || name.find('/') != std::string::npos)
+		throw_with_trace(std::runtime_error("Invalid name '{}' for the live stats, it cannot be empty or have slashes"_format(name)));
+}
+
+
+LiveStats::~LiveStats()
+{
+	remove();
+}
+
+
+void LiveStats::remove()
+{
+	if (!mem)
+		return;
+	munmap(mem, length);
+	mem = nullptr;
+	header = nullptr;
+	masks = nullptr;
+	tasks = nullptr;
+	if (shm_unlink(("/" + name).c_str()) < 0)
+		LOGWAR("Could not remove the live stats '{}': {}"_format(name, strerror(errno)));
+}
+
+
+void LiveStats::init(const Task &task)
+{
+	assert(!mem);
+
+	const auto columns = task.stats.column_names();
+	const size_t task_size = sizeof(TaskRecord) + (1 + columns.size()) * sizeof(double);
+	length = sizeof(live::Header) + columns.size() * live::name_size + num_clos * sizeof(uint64_t) + live::max_tasks * task_size;
+
+	int fd = shm_open(("/" + name).c_str(), O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		throw_with_trace(std::runtime_error("Could not create the live stats '{}': {}"_format(name, strerror(errno))));
+	if (ftruncate(fd, length) < 0)
+	{
+		close(fd);
+		throw_with_trace(std::runtime_error("Could not resize the live stats '{}': {}"_format(name, strerror(errno))));
+	}
+	mem = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		mem = nullptr;
+		throw_with_trace(std::runtime_error("Could not map the live stats '{}': {}"_format(name, strerror(errno))));
+	}
+
+	// The segment is zeroed, the sequence starts at 0
+	char *p = (char *) mem;
+	header = new (p) live::Header();
+	p += sizeof(live::Header);
+	for (const auto &col : columns)
+	{
+		strncpy(p, col.c_str(), live::name_size - 1);
+		p += live::name_size;
+	}
+	masks = (uint64_t *) p;
+	p += num_clos * sizeof(uint64_t);
+	tasks = p;
+
+	header->version = live::version;
+	header->pid = getpid();
+	header->num_columns = columns.size();
+	header->max_tasks = live::max_tasks;
+	header->num_clos = num_clos;
+	header->name_size = live::name_size;
+	header->task_size = task_size;
+
+	// Readers check the magic last
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header->magic, live::magic, sizeof(live::magic));
+
+	LOGINF("Live stats published in /dev/shm/{}"_format(name));
+}
+
+
+void LiveStats::publish(uint32_t interval, const tasklist_t &tasklist, const CAT &cat)
+{
+	static const metric_t instructions = Stats::metric("instructions");
+
+	if (!mem)
+		return;
+
+	// Read the masks before entering the critical section, it may take a syscall
+	for (uint32_t clos = 0; clos < num_clos; clos++)
+		new_masks[clos] = cat.get_cbm(clos);
+
+	if (tasklist.size() > live::max_tasks && !warned)
+	{
+		LOGWAR("Only the first {} tasks are published in the live stats"_format(live::max_tasks));
+		warned = true;
+	}
+	size_t n = std::min<size_t>(tasklist.size(), live::max_tasks);
+
+	uint64_t seq = header->seq.load(std::memory_order_relaxed);
+	header->seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	header->interval = interval;
+	header->time_ns = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+	header->num_tasks = n;
+	std::copy(new_masks.begin(), new_masks.end(), masks);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		const Task &task = *tasklist[i];
+		char *rec = tasks + i * header->task_size;
+		auto *fixed = (TaskRecord *) rec;
+		fixed->id = task.id;
+		fixed->pid = task.pid;
+		fixed->cpu = task.cpu;
+		memset(fixed->name, 0, sizeof(fixed->name));
+		strncpy(fixed->name, task.name.c_str(), sizeof(fixed->name) - 1);
+
+		double *values = (double *) (rec + sizeof(TaskRecord));
+		values[0] = task.max_instr ?
+				(double) task.stats.sum(instructions) / (double) task.max_instr :
+				NAN;
+		if (task.stats.num_columns() == header->num_columns)
+			task.stats.data_int(values + 1);
+		else
+			std::fill(values + 1, values + 1 + header->num_columns, NAN);
+	}
+
+	header->seq.store(seq + 2, std::memory_order_release);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cat.hpp"
+#include "task.hpp"
+
+
+// Publishes the last interval stats of every task, and the masks of the CLOSes, in a POSIX shared memory
+// segment (/dev/shm/<name>), so other processes can watch a running experiment. The segment is updated
+// once per interval under a sequence lock: readers copy it and retry if the sequence was odd or has
+// changed in the meantime. See scripts/livestats.py.
+//
+// Layout, little-endian:
+//  - header (struct LiveHeader below)
+//  - num_columns column names, name_size bytes each, padded with NULs
+//  - num_clos masks (uint64)
+//  - max_tasks task records of task_size bytes: id (uint32), pid and CPU (int32), reserved (uint32),
+//    the name (name_size bytes), the completed fraction and the value of every column (double)
+namespace live
+{
+	const char magic[8] = {'C', 'P', 'A', 'L', 'I', 'V', 'E', '\0'};
+	const uint32_t version = 1;
+	const uint32_t name_size = 48;
+	const uint32_t max_tasks = 256;
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		int32_t pid;               // Of the manager, to detect segments left by a dead one
+		std::atomic<uint64_t> seq; // Odd while the segment is being written
+		uint32_t num_columns;
+		uint32_t max_tasks;
+		uint32_t num_tasks;
+		uint32_t num_clos;
+		uint64_t interval;
+		int64_t time_ns;           // Realtime clock when it was published
+		uint32_t name_size;
+		uint32_t task_size;
+	};
+	static_assert(sizeof(Header) == 64, "The header of the live stats must have a fixed layout");
+	static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The sequence of the live stats must be lock-free to be shared between processes");
+}
+
+
+class LiveStats
+{
+	std::string name;
+	uint32_t num_clos;
+	void *mem = nullptr;
+	size_t length = 0;
+	live::Header *header = nullptr;
+	uint64_t *masks = nullptr;
+	char *tasks = nullptr;
+	std::vector<uint64_t> new_masks;
+	bool warned = false;
+
+	public:
+
+	LiveStats() = delete;
+	LiveStats(const std::string &_name, uint32_t _num_clos);
+	~LiveStats();
+
+	LiveStats(const LiveStats&) = delete;
+	LiveStats& operator=(const LiveStats&) = delete;
+
+	// Create the segment, the columns are taken from the stats of the task
+	void init(const Task &task);
+
+	// Must be called from a single thread
+	void publish(uint32_t interval, const tasklist_t &tasklist, const CAT &cat);
+
+	// Unmap and remove the segment, also done by the destructor. Nothing can be published afterwards.
+	void remove();
+};
+typedef std::shared_ptr<LiveStats> live_stats_ptr_t;
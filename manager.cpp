@@ -22,6 +22,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <csignal>
 #include <thread>
 
+#include <boost/accumulators/accumulators.hpp>
+#include <boost/accumulators/statistics/count.hpp>
+#include <boost/accumulators/statistics/max.hpp>
+#include <boost/accumulators/statistics/mean.hpp>
+#include <boost/accumulators/statistics/stats.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 #include <boost/stacktrace.hpp>
@@ -31,17 +36,28 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <signal.h>
 #include <setjmp.h>
 
+#include "async-output.hpp"
+#include "attach.hpp"
+#include "binary-output.hpp"
 #include "cat-intel.hpp"
 #include "cat-linux.hpp"
 #include "cat-policy.hpp"
 #include "common.hpp"
 #include "config.hpp"
 #include "events-perf.hpp"
+#include "freezer.hpp"
+#include "instr-limit.hpp"
+#include "live-stats.hpp"
 #include "log.hpp"
+#include "overhead.hpp"
+#include "pipeline.hpp"
+#include "sampling-clock.hpp"
 #include "stats.hpp"
 #include "task.hpp"
+#include "worker-pool.hpp"
 
 
+namespace acc = boost::accumulators;
 namespace chr = std::chrono;
 namespace fs = boost::filesystem;
 namespace po = boost::program_options;
@@ -49,22 +65,19 @@ namespace po = boost::program_options;
 using std::string;
 using std::to_string;
 using std::vector;
-using std::this_thread::sleep_for;
 using std::cout;
 using std::cerr;
 using std::endl;
 using fmt::literals::operator""_format;
 
 typedef std::shared_ptr<CAT> CAT_ptr_t;
-typedef std::chrono::system_clock::time_point time_point_t;
 
 
-CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist);
-void loop(tasklist_t &tasklist, std::shared_ptr<cat::policy::Base> catpol, Perf &perf, const vector<string> &events, uint64_t time_int_us, uint32_t max_int, std::ostream &out, std::ostream &ucompl_out, std::ostream &total_out);
-void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf);
-[[noreturn]] void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf);
+CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist, bool verify);
+void loop(tasklist_t &tasklist, tasklist_t &pending, sched::ptr_t &sched, std::shared_ptr<cat::policy::Base> catpol, Perf &perf, WorkerPool &pool, const vector<string> &events, uint64_t time_int_us, uint32_t max_int, bool pipeline, PauseMode pause_mode, freezer_ptr_t freezer, attacher_ptr_t attacher, limiter_ptr_t limiter, Overhead &overhead, binout_ptr_t binout, live_stats_ptr_t live, std::ostream &out, std::ostream &ucompl_out, std::ostream &total_out);
+void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf, freezer_ptr_t freezer);
+[[noreturn]] void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf, freezer_ptr_t freezer);
 std::string program_options_to_string(const std::vector<po::option>& raw);
-void adjust_time(const time_point_t &start_int, const time_point_t &start_glob, const uint64_t interval, const uint64_t time_int_us, int64_t &adj_delay_us);
 void herod_the_great();
 void sigint_handler(int signum);
 void sigabrt_handler(int signum);
@@ -72,8 +85,11 @@ void sigabrt_handler(int signum);
 // Signal
 jmp_buf return_to_top_level;
 
+// Decision stage of the running loop, the signal handlers leave it running
+std::weak_ptr<DecisionStage> running_decision;
 
-CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist)
+
+CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist, bool verify)
 {
 	LOGINF("Using {} CAT"_format(kind));
 	std::shared_ptr<CAT> cat;
@@ -84,7 +100,7 @@ CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist)
 	else
 	{
 		assert(kind == "linux");
-		cat = std::make_shared<CATLinux>();
+		cat = std::make_shared<CATLinux>(verify);
 	}
 	cat->init();
 
@@ -102,12 +118,22 @@ CAT_ptr_t cat_setup(const string &kind, const vector<Cos> &coslist)
 
 void loop(
 		tasklist_t &tasklist,
+		tasklist_t &pending,
 		sched::ptr_t &sched,
 		std::shared_ptr<cat::policy::Base> catpol,
 		Perf &perf,
+		WorkerPool &pool,
 		const vector<string> &events,
 		uint64_t time_int_us,
 		uint32_t max_int,
+		bool pipeline,
+		PauseMode pause_mode,
+		freezer_ptr_t freezer,
+		attacher_ptr_t attacher,
+		limiter_ptr_t limiter,
+		Overhead &overhead,
+		binout_ptr_t binout,
+		live_stats_ptr_t live,
 		std::ostream &out,
 		std::ostream &ucompl_out,
 		std::ostream &total_out)
@@ -117,88 +143,336 @@ void loop(
 	if (max_int <= 0)
 		throw_with_trace(std::runtime_error("Max time must be positive and greater than 0"));
 
-	// Prepare Perf to measure events and initialize stats
-	for (const auto &task : tasklist)
-		task->stats.init(perf.get_names(task->pid)[0]);
+	const metric_t instructions = Stats::metric("instructions");
+
+	// Have the kernel stop the task when it reaches its instruction limit. If that is not possible,
+	// the limit is still checked at the end of every interval.
+	auto task_arm_limit = [&](const Task &task)
+	{
+		if (!limiter || task.attached)
+			return;
+		try
+		{
+			limiter->arm(task);
+		}
+		catch (const std::exception &e)
+		{
+			LOGWAR(e.what());
+		}
+	};
+
+	// Initialize the stats of a task with the first reading of its counters.
+	// Headers are printed with the first task, attached tasks may not exist yet.
+	bool headers_printed = false;
+	auto task_start_counting = [&](Task &task)
+	{
+		task.stats.init(perf.get_names(task.pid)[0]);
 
-	// Print headers
-	task_stats_print_headers(*tasklist[0], out);
-	task_stats_print_headers(*tasklist[0], ucompl_out);
-	task_stats_print_headers(*tasklist[0], total_out);
+		if (!headers_printed)
+		{
+			task_stats_print_headers(task, out, false);
+			task_stats_print_headers(task, ucompl_out, true);
+			task_stats_print_headers(task, total_out, true);
+			if (binout)
+				binout->write_schema(task);
+			if (live)
+				live->init(task);
+			headers_printed = true;
+		}
+
+		perf.enable_counters(task.pid);
+		perf.sample_energy();
+		task.cpu = get_cpu_id(task.pid);
+		const CounterSnapshot &counters = perf.read_counters(task.pid, catpol->get_cat(), task.cpu)[0];
+		const auto now = mono_clock_t::now();
+		task.stats.accum(counters, now, now);
+		task_arm_limit(task);
+	};
+
+	// Tasks are launched paused, they are let run according to the pause mode
+	auto task_start_running = [&](const task_ptr_t &task_ptr)
+	{
+		if (pause_mode == PauseMode::none)
+			task_resume(*task_ptr);
+		else if (pause_mode == PauseMode::freezer)
+			freezer->adopt({task_ptr});
+	};
+
+	// Launch the tasks whose arrival time has come, they are added to the tasklist
+	auto launch_arrived_tasks = [&](uint32_t next_interval, double elapsed_seconds)
+	{
+		auto result = tasklist_t();
+		for (auto it = pending.begin(); it != pending.end();)
+		{
+			const auto &task = *it;
+			if (!task_has_arrived(*task, next_interval, elapsed_seconds))
+			{
+				++it;
+				continue;
+			}
+
+			LOGINF("Task {}:{} arrives at interval {}"_format(task->id, task->name, next_interval));
+			task_execute(*task);
+			task_admit(*task, catpol->get_cat(), perf, events);
+			task_start_counting(*task);
+			task_start_running(task);
+			catpol->task_added(*task);
+			tasklist.push_back(task);
+			result.push_back(task);
+			it = pending.erase(it);
+		}
+		return result;
+	};
+
+	// Look for processes to attach to, they are added to the tasklist
+	auto attach_new_tasks = [&]()
+	{
+		auto result = tasklist_t();
+		for (const auto &task : attacher->scan())
+		{
+			// The process may have exited in the meantime
+			try
+			{
+				task_admit(*task, catpol->get_cat(), perf, events);
+				task_start_counting(*task);
+			}
+			catch (const std::exception &e)
+			{
+				LOGWAR("Could not attach task {}:{} to pid {}: {}"_format(task->id, task->name, task->pid, e.what()));
+				perf.clean(task->pid);
+				continue;
+			}
+			catpol->task_added(*task);
+			tasklist.push_back(task);
+			result.push_back(task);
+		}
+		return result;
+	};
 
 	// First reading of counters
 	for (const auto &task : tasklist)
-	{
-		perf.enable_counters(task->pid);
-		const counters_t counters = perf.read_counters(task->pid,catpol->get_cat())[0];
-		task->stats.accum(counters);
-	}
+		task_start_counting(*task);
+	if (attacher)
+		attach_new_tasks();
+	overhead.print_headers();
 
 	// Loop
 	uint32_t interval;
-	int64_t adj_delay_us = time_int_us;
-	auto start_glob = std::chrono::system_clock::now();
-	auto t1 = std::chrono::system_clock::now(); //measure overhead algorithm
-	auto t2 = std::chrono::system_clock::now();
+	const auto period = chr::microseconds(time_int_us);
+	SamplingClock sampling_clock(period);
+	auto t1 = mono_clock_t::now(); //measure overhead algorithm
+	auto t2 = mono_clock_t::now();
 	uint64_t total_elapsed_us = 0;
 
+	// Measured length of the intervals and delay of the wake ups with respect to the deadlines
+	acc::accumulator_set<double, acc::stats<acc::tag::mean, acc::tag::max>> duration_acc, jitter_acc;
+
+	const auto cat_linux = std::dynamic_pointer_cast<CATLinux>(catpol->get_cat());
+
 	tasklist_t runlist = tasklist_t(tasklist); // Tasks that are not done
 	tasklist_t schedlist = tasklist_t(runlist);
+
+	// Output and CAT policy, they can run concurrently with the next interval. The decision stage
+	// lives in the heap and captures nothing from this stack frame by reference, so it can still
+	// be stopped after a signal has left the loop.
+	const auto decision_ptr = std::make_shared<DecisionStage>([&overhead, &out, binout, catpol, live](const IntervalSnapshot &snapshot)
+	{
+		// Print interval stats
+		{
+			StageTimer timer(overhead, snapshot.interval, Stage::output);
+			for (const auto &task_ptr : snapshot.sampled)
+				task_stats_print_interval(*task_ptr, snapshot.interval, out);
+			if (binout)
+			{
+				for (const auto &task_ptr : snapshot.sampled)
+					binout->write_interval(*task_ptr, snapshot.interval);
+				binout->flush();
+			}
+		}
+
+		// Adjust CAT according to the selected policy
+		if (snapshot.apply_policy)
+		{
+			StageTimer timer(overhead, snapshot.interval, Stage::catpol);
+			catpol->apply(snapshot.interval, snapshot.schedlist);
+		}
+
+		// Publish the stats of the interval and the resulting CAT configuration
+		if (live)
+		{
+			StageTimer timer(overhead, snapshot.interval, Stage::output);
+			live->publish(snapshot.interval, snapshot.sampled, *catpol->get_cat());
+		}
+	}, pipeline);
+	DecisionStage &decision = *decision_ptr;
+	running_decision = decision_ptr;
+	if (pipeline)
+		LOGINF("Output and CAT policy run in their own thread");
+
+	// Without pauses the tasks are resumed only once, and they keep running while we read their counters
+	const bool pause = pause_mode != PauseMode::none;
+	LOGINF("Pause mode: {}"_format(pause_mode_to_str(pause_mode)));
+	if (!pause)
+		tasks_resume(schedlist);
+	else if (pause_mode == PauseMode::freezer)
+		freezer->adopt(tasklist);
+
+	// A task has been stopped by its instruction limit in the middle of the interval. It is finished and
+	// restarted right away, instead of at the end of the interval.
+	auto handle_instr_limits = [&]()
+	{
+		const auto reached = limiter->reached(schedlist);
+		if (reached.empty())
+			return;
+
+		// The decision stage may still be using the stats
+		decision.wait();
+		perf.sample_energy();
+
+		for (const auto &task_ptr : reached)
+		{
+			Task &task = *task_ptr;
+
+			// Last reading of this execution
+			task.cpu = get_cpu_id(task.pid);
+			const CounterSnapshot &counters = perf.read_counters(task.pid, catpol->get_cat(), task.cpu)[0];
+			const auto now = mono_clock_t::now();
+			task.stats.accum(counters, pause ? t2 : task.stats.last_time(), now);
+			LOGINF("Task {}:{} stopped at {} instructions, the limit is {}"_format(task.id, task.name, task.stats.get_current(instructions), task.max_instr));
+
+			task.set_status(Task::Status::limit_reached);
+			task.completed++;
+			if (task.completed == 1)
+				task_stats_print_total(task, interval, ucompl_out);
+			limiter->disarm(task);
+
+			task_restart_or_set_done(task, catpol->get_cat(), perf, events); // Status can change from limit_reached -> done
+			if (task.get_status() == Task::Status::runnable)
+			{
+				// The rest of the tasks are running
+				if (pause_mode == PauseMode::freezer)
+				{
+					freezer->adopt({task_ptr});
+					freezer->thaw({task_ptr});
+				}
+				else
+				{
+					task_resume(task);
+				}
+				task_arm_limit(task);
+			}
+			else
+			{
+				task_stats_print_total(task, interval, total_out);
+				catpol->task_removed(task);
+				schedlist.erase(std::remove(schedlist.begin(), schedlist.end(), task_ptr), schedlist.end());
+				runlist.erase(std::remove(runlist.begin(), runlist.end(), task_ptr), runlist.end());
+			}
+		}
+	};
+	if (limiter)
+		sampling_clock.watch(limiter->get_fd(), handle_instr_limits);
+
+	sampling_clock.start();
 	for (interval = 0; interval < max_int; interval++)
 	{
-		auto start_int = std::chrono::system_clock::now();
+		auto start_int = mono_clock_t::now();
 		bool all_completed = true; // Have all the tasks reached their execution limit?
 
-		LOGINF("Starting interval {} - {} us"_format(interval, chr::duration_cast<chr::microseconds> (start_int - start_glob).count()));
+		LOGINF("Starting interval {} - {} us"_format(interval, to_us(start_int - sampling_clock.get_origin())));
 
 		// Sleep
-		t2 = std::chrono::system_clock::now();
+		t2 = mono_clock_t::now();
 		if (interval > 0)
 		{
-			uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>  (t2 - t1).count();
+			uint64_t elapsed_us = to_us(t2 - t1);
 			uint32_t prev_interval = interval - 1;
 			LOGINF("[OVERHEAD] Interval {} - {} = {} us"_format(interval,prev_interval,elapsed_us));
 			total_elapsed_us = total_elapsed_us + elapsed_us;
 		}
-		tasks_resume(schedlist);
-		sleep_for(chr::microseconds(adj_delay_us));
-		tasks_pause(schedlist); // Status can change from runnable -> exited
-		LOGDEB("Slept for {} us"_format(adj_delay_us));
-		t1 = std::chrono::system_clock::now();
+		{
+			StageTimer timer(overhead, interval, Stage::resume);
+			if (pause_mode == PauseMode::signal)
+				tasks_resume(schedlist);
+			else if (pause_mode == PauseMode::freezer)
+				freezer->thaw(schedlist);
+		}
+		SamplingClock::Tick tick;
+		{
+			StageTimer timer(overhead, interval, Stage::sleep);
+			tick = sampling_clock.wait();
+		}
+		{
+			StageTimer timer(overhead, interval, Stage::pause);
+			if (pause_mode == PauseMode::signal)
+			{
+				tasks_pause(schedlist); // Status can change from runnable -> exited
+			}
+			else
+			{
+				if (pause_mode == PauseMode::freezer)
+					freezer->freeze(schedlist);
+				tasks_check_exited(schedlist); // Status can change from runnable -> exited
+			}
+		}
+		LOGDEB("Slept for {} us"_format(to_us(tick.time - t2)));
+		t1 = mono_clock_t::now();
 
-		// Control elapsed time
-		adjust_time(start_int, start_glob, interval, time_int_us, adj_delay_us);
+		// Keep track of how precise the intervals are
+		duration_acc(to_us(tick.duration));
+		jitter_acc(to_us(tick.jitter));
+		LOGDEB("[TIMING] Interval {}: duration {} us, jitter {} us"_format(interval, to_us(tick.duration), to_us(tick.jitter)));
 
 		// Get CPU of manager
 		int cpu_manager =  get_self_cpu_id();
 		LOGDEB("----> Manager is in CPU {}"_format(cpu_manager));
 
-		// Process tasks...
-		for (const auto &task_ptr : schedlist)
+		// The previous interval has to be completely processed before touching the stats again
+		decision.wait();
+		overhead.flush(interval);
+
+		// Read and accumulate the counters of the tasks in parallel
+		perf.sample_energy();
+		overhead.begin_tasks(schedlist.size());
+		pool.run(schedlist.size(), [&](size_t i)
 		{
-			Task &task = *task_ptr;
+			Task &task = *schedlist[i];
 			// Get CPU of task
-			int cpu_id = get_cpu_id(task.pid);
-			LOGDEB("----> Task {} is in CPU {}"_format(task.pid,cpu_id));
+			task.cpu = get_cpu_id(task.pid);
+			LOGDEB("----> Task {} is in CPU {}"_format(task.pid,task.cpu));
 
 			// Read stats
-			const counters_t counters = perf.read_counters(task.pid, catpol->get_cat())[0];
-			task.stats.accum(counters);
+			// When pausing, the tasks have been running from just before being resumed until they were paused,
+			// or since they were restarted by their instruction limit in the middle of the interval.
+			// If not, the sample covers the time since the previous read of this very task.
+			const auto read_start = mono_clock_t::now();
+			const CounterSnapshot &counters = perf.read_counters(task.pid, catpol->get_cat(), task.cpu)[0];
+			const auto read_end = mono_clock_t::now();
+			if (pause)
+				task.stats.accum(counters, std::max(t2, task.stats.last_time()), t1);
+			else
+				task.stats.accum(counters, task.stats.last_time(), read_end);
+			overhead.record_task(i, Stage::read, read_end - read_start);
+			overhead.record_task(i, Stage::accum, mono_clock_t::now() - read_end);
 
 			// Test if the instruction limit has been reached
-			if (task.max_instr > 0 && task.stats.get_current("instructions") >=  task.max_instr)
+			if (task.max_instr > 0 && task.stats.get_current(instructions) >=  task.max_instr)
 			{
 				task.set_status(Task::Status::limit_reached); // Status can change from runnable -> limit_reached
 				task.completed++;
 			}
+		});
+		overhead.end_tasks(interval);
+
+		// Process tasks, in order...
+		for (const auto &task_ptr : schedlist)
+		{
+			Task &task = *task_ptr;
 
 			// If any non-batch task is not completed then we don't finish
 			if (!task.completed && !task.batch)
 				all_completed = false;
 
-			// Print interval stats
-			task_stats_print_interval(task, interval, out);
-
 			// It's the first time it finishes or reaches the instruction limit print acumulated stats until this point
 			if (task.get_status() == Task::Status::limit_reached || task.get_status() == Task::Status::exited)
 			{
@@ -207,38 +481,107 @@ void loop(
 			}
 		}
 
+		IntervalSnapshot snapshot;
+		snapshot.interval = interval;
+		snapshot.sampled = schedlist;
+
+		// Tasks that have not arrived yet have not been completed either
+		for (const auto &task_ptr : pending)
+			if (!task_ptr->batch)
+				all_completed = false;
+
+		// Attached processes can appear at any moment, we run until the interval limit
+		if (attacher)
+			all_completed = false;
+
 		// All the tasks have reached their limit -> finish execution
 		if (all_completed)
 		{
+			decision.submit(std::move(snapshot));
 			LOGINF("[TOTAL OVERHEAD] {} us"_format(total_elapsed_us));
 			break;
 		}
 
+		bool clos_stale = false; // Some task has ended or restarted
 		for (const auto &task_ptr : schedlist)
 		{
 			// Deal with apps that finish or reach the limit
 			// COMMENT IN CASE OF USING KPART'S METHODOLOGY
+			const pid_t pid = task_ptr->pid;
 			task_restart_or_set_done(*task_ptr, catpol->get_cat(), perf, events); // Status can change from (exited | limit_reached) -> done
 
+			// Restarted tasks start paused
+			if (task_ptr->pid != pid && task_ptr->get_status() == Task::Status::runnable)
+			{
+				task_start_running(task_ptr);
+				task_arm_limit(*task_ptr);
+			}
+			if (task_ptr->pid != pid || task_ptr->get_status() == Task::Status::done)
+				clos_stale = true;
+
 			// If it's done print total stats
 			if (task_ptr->get_status() == Task::Status::done)
+			{
 				task_stats_print_total(*task_ptr, interval, total_out);
+				catpol->task_removed(*task_ptr);
+				if (limiter)
+					limiter->disarm(*task_ptr);
+			}
 		}
 
+		// The children of the tasks that have ended or restarted may have left their CLOS, or been
+		// moved by the policy. With verify, every lookup is already checked against resctrl.
+		if (clos_stale && cat_linux && !cat_linux->get_verify())
+			cat_linux->reconcile_tasks();
+
 		// Remove tasks that are done from runlist
 		runlist.erase(std::remove_if(runlist.begin(), runlist.end(), [](const auto &task_ptr) { return task_ptr->get_status() == Task::Status::done; }), runlist.end());
-		assert(!runlist.empty());
+
+		// Attached processes that are gone have printed their totals, drop them so their stats do not pile up
+		if (attacher)
+			tasklist.erase(std::remove_if(tasklist.begin(), tasklist.end(), [](const auto &task_ptr) { return task_ptr->attached && task_ptr->get_status() == Task::Status::done; }), tasklist.end());
+
+		// New tasks will run during the next interval
+		if (!pending.empty())
+		{
+			const auto new_tasks = launch_arrived_tasks(interval + 1, to_us(mono_clock_t::now() - sampling_clock.get_origin()) / 1e6);
+			runlist.insert(runlist.end(), new_tasks.begin(), new_tasks.end());
+		}
+		if (attacher)
+		{
+			const auto new_tasks = attach_new_tasks();
+			runlist.insert(runlist.end(), new_tasks.begin(), new_tasks.end());
+		}
 
 		// Select tasks for next interval execution
-		schedlist = sched->apply(interval, runlist);
-		assert(!schedlist.empty());
+		if (runlist.empty())
+		{
+			assert(attacher || !pending.empty()); // Waiting for tasks to arrive
+			schedlist.clear();
+		}
+		else
+		{
+			StageTimer timer(overhead, interval, Stage::sched);
+			schedlist = sched->apply(interval, runlist);
+			assert(!schedlist.empty());
+		}
 
 		LOGDEB(iterable_to_string(schedlist.begin(), schedlist.end(), [](const auto &t) {return "{}:{}[{}]({})"_format(t->id, t->name, sched::Status(t->pid)("Cpus_allowed_list"), sched::Stat(t->pid).processor);}, " "));
 
-		// Adjust CAT according to the selected policy
-		catpol->apply(interval, schedlist);
+		// Print the interval and apply the CAT policy
+		snapshot.schedlist = schedlist;
+		snapshot.apply_policy = !schedlist.empty();
+		decision.submit(std::move(snapshot));
 	}
 
+	decision.wait();
+	overhead.flush_all();
+	overhead.log_summary();
+
+	if (acc::count(duration_acc))
+		LOGINF("[TIMING] Interval duration: mean {} us, max {} us. Jitter: mean {} us, max {} us"_format(
+				acc::mean(duration_acc), acc::max(duration_acc), acc::mean(jitter_acc), acc::max(jitter_acc)));
+
 	// Print acumulated stats for non completed tasks and total stats for all the tasks
 	for (const auto &task : tasklist)
 	{
@@ -253,40 +596,19 @@ void loop(
 }
 
 
-void adjust_time(const time_point_t &start_int, const time_point_t &start_glob, const uint64_t interval, const uint64_t time_int_us, int64_t &adj_delay_us)
-{
-	// Control elapsed time
-	uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>
-			(std::chrono::system_clock::now() - start_int).count();
-	uint64_t total_elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>
-			(std::chrono::system_clock::now() - start_glob).count();
-
-	uint64_t last = adj_delay_us;
-
-	// Adjust time with a PI controller
-	const double kp = 0.5;
-	const double ki = 0.25;
-	int64_t proportional = (int64_t) time_int_us - (int64_t) elapsed_us;
-	int64_t integral     = (int64_t) time_int_us * (interval + 1) - (int64_t) total_elapsed_us;
-	adj_delay_us += kp * proportional;
-	adj_delay_us += ki * integral;
-
-	if (adj_delay_us < 0)
-	{
-		last *= 0;
-		LOGINF("This interval ({}) was way too long. The next interval should last {} us. It will last {}."_format(interval, adj_delay_us, last));
-		adj_delay_us = last;
-	}
-}
-
-
 // Leave the machine in a consistent state
-void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf)
+void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf, freezer_ptr_t freezer)
 {
 	LOGINF("Resetting CAT and performance counters...");
 	cat->reset();
 	perf.clean();
 
+	if (freezer)
+	{
+		LOGINF("Removing freezer cgroups...");
+		freezer->clean();
+	}
+
 	// Try to drop privileges before killing anything
 	LOGINF("Dropping privileges...");
 	drop_privileges();
@@ -295,7 +617,8 @@ void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf)
 	try
 	{
 		for (const auto &task : tasklist)
-			fs::remove_all(task->rundir);
+			if (!task->attached)
+				fs::remove_all(task->rundir);
 	}
 	catch(const std::exception &e)
 	{
@@ -311,7 +634,7 @@ void clean(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf)
 }
 
 
-void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf)
+void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf, freezer_ptr_t freezer)
 {
 	LOGERR("--- PANIC, TRYING TO CLEAN ---");
 
@@ -334,6 +657,9 @@ void clean_and_die(tasklist_t &tasklist, CAT_ptr_t cat, Perf &perf)
 		LOGERR("Could not clean the performance counters: " << e.what());
 	}
 
+	if (freezer)
+		freezer->clean();
+
 	// Kill children
 	herod_the_great();
 
@@ -457,6 +783,7 @@ int main(int argc, char *argv[])
 		("output,o", po::value<string>()->default_value(""), "pathname for output")
 		("fin-output", po::value<string>()->default_value(""), "pathname for output values when tasks are completed")
 		("total-output", po::value<string>()->default_value(""), "pathname for total output values")
+		("overhead-output", po::value<string>()->default_value(""), "pathname for the per interval overhead of each stage of the main loop (CSV)")
 		("rundir", po::value<string>()->default_value("run"), "directory for creating the directories where the applications are gonna be executed")
 		("id", po::value<string>()->default_value(random_string(10)), "identifier for the experiment")
 		("ti", po::value<double>(), "time-interval, duration in seconds of the time interval to sample performance counters.")
@@ -467,6 +794,14 @@ int main(int argc, char *argv[])
 		("flog-min", po::value<string>()->default_value(min_flog), "Minimum severity level to log into the log file, defaults to info")
 		("log-file", po::value<string>()->default_value("manager.log"), "file used for the general application log")
 		("cat-impl", po::value<string>(), "Which implementation of CAT to use (linux or intel)")
+		("cat-verify", po::value<bool>(), "check the cached CAT state against resctrl every time it is read (linux CAT only)")
+		("collect-threads", po::value<uint32_t>(), "number of threads, pinned to the cpu-affinity cpus, used to read the counters of the tasks")
+		("pipeline", po::value<bool>(), "print the results and apply the CAT policy in a separate thread, while the tasks run the next interval")
+		("pause-mode", po::value<string>(), "how to stop the tasks while the manager works: 'signal' (SIGSTOP/SIGCONT every interval), 'none' (the counters are read while the tasks run) or 'freezer' (cgroup v2 freezer, stops the whole process tree of each task)")
+		("async-output", po::value<bool>(), "write the output files from a separate thread, so slow disks or pipes do not delay the intervals")
+		("output-flush", po::value<double>(), "with async-output, maximum seconds the output stays in memory before being written, 0 writes every line")
+		("binary-output", po::value<string>()->default_value(""), "pathname for the interval stats in binary format, read with scripts/binout.py")
+		("live-stats", po::value<string>()->default_value(""), "name of a shared memory segment (in /dev/shm) where the last stats are published every interval, read with scripts/livestats.py")
 		;
 
 	bool option_error = false;
@@ -514,9 +849,32 @@ int main(int argc, char *argv[])
 	auto total_out  = std::shared_ptr<std::ostream>();
 	open_output_streams(vm["output"].as<string>(), vm["fin-output"].as<string>(), vm["total-output"].as<string>(), int_out, ucompl_out, total_out);
 
+	// Overhead of the stages of the main loop, only summarized in the log if there is no output for it
+	auto overhead_out = std::shared_ptr<std::ostream>();
+	if (vm["overhead-output"].as<string>() != "")
+	{
+		overhead_out.reset(new std::ofstream(vm["overhead-output"].as<string>()));
+		if (!overhead_out->good())
+			LOGFAT("Could not open the overhead output '{}'"_format(vm["overhead-output"].as<string>()));
+	}
+	Overhead overhead(overhead_out);
+
+	// Interval stats in binary format, in addition to the text ones
+	auto binout_out = std::shared_ptr<std::ostream>();
+	if (vm["binary-output"].as<string>() != "")
+	{
+		binout_out.reset(new std::ofstream(vm["binary-output"].as<string>(), std::ios::binary));
+		if (!binout_out->good())
+			LOGFAT("Could not open the binary output '{}'"_format(vm["binary-output"].as<string>()));
+	}
+
 	// Read config
 	auto tasklist = tasklist_t();
+	auto pending = tasklist_t();
+	auto attachlist = vector<AttachSpec>();
 	auto coslist = vector<Cos>();
+	auto derived = vector<DerivedMetric>();
+	auto quantiles = QuantileMetrics();
 	CAT_ptr_t cat;
 	sched::ptr_t sched;
 	auto perf = Perf();
@@ -527,8 +885,15 @@ int main(int argc, char *argv[])
 		// Read config and set tasklist and coslist
 		config_file = vm["config"].as<string>();
 		string config_override = vm["config-override"].as<string>();
-		config_read(config_file, config_override, options, tasklist, coslist, catpol, sched);
+		config_read(config_file, config_override, options, tasklist, attachlist, coslist, catpol, sched, derived, quantiles);
+		Stats::define_derived_metrics(derived);
+		Stats::define_quantile_metrics(quantiles);
 		tasks_set_rundirs(tasklist, vm["rundir"].as<string>() + "/" + vm["id"].as<string>());
+
+		// Tasks that arrive later are launched by the main loop
+		auto it = std::stable_partition(tasklist.begin(), tasklist.end(), [](const auto &t) { return task_has_arrived(*t, 0, 0); });
+		pending = tasklist_t(it, tasklist.end());
+		tasklist.erase(it, tasklist.end());
 	}
 	catch(const YAML::ParserException &e)
 	{
@@ -547,6 +912,8 @@ int main(int argc, char *argv[])
 	// The priority order is: commandline > config file > option defaults
 	if (!vm["cat-impl"].empty())
 		options.cat_impl = vm["cat-impl"].as<string>();
+	if (!vm["cat-verify"].empty())
+		options.cat_verify = vm["cat-verify"].as<bool>();
 	if (!vm["ti"].empty())
 		options.ti = vm["ti"].as<double>();
 	if (!vm["mi"].empty())
@@ -555,15 +922,107 @@ int main(int argc, char *argv[])
 		options.event = vm["event"].as<vector<string>>();
 	if (!vm["cpu-affinity"].empty())
 		options.cpu_affinity = vm["cpu-affinity"].as<vector<uint32_t>>();
+	if (!vm["collect-threads"].empty())
+		options.collect_threads = vm["collect-threads"].as<uint32_t>();
+	if (!vm["pipeline"].empty())
+		options.pipeline = vm["pipeline"].as<bool>();
+	if (!vm["pause-mode"].empty())
+		options.pause_mode = vm["pause-mode"].as<string>();
+	if (!vm["async-output"].empty())
+		options.async_output = vm["async-output"].as<bool>();
+	if (!vm["output-flush"].empty())
+		options.output_flush = vm["output-flush"].as<double>();
+
+	PauseMode pause_mode = PauseMode::signal;
+	try
+	{
+		pause_mode = pause_mode_from_str(options.pause_mode);
+	}
+	catch (const std::exception &e)
+	{
+		LOGFAT(e.what());
+	}
+
+	// The kernel stops the tasks that reach their instruction limit, and tells us with a SIGCHLD.
+	// It has to be blocked before any thread is created.
+	limiter_ptr_t limiter;
+	if (std::any_of(tasklist.begin(), tasklist.end(), [](const auto &t) { return t->max_instr > 0; }) ||
+			std::any_of(pending.begin(), pending.end(), [](const auto &t) { return t->max_instr > 0; }))
+	{
+		try
+		{
+			InstrLimiter::block_sigchld();
+			limiter = std::make_shared<InstrLimiter>();
+		}
+		catch (const std::exception &e)
+		{
+			LOGFAT(e.what());
+		}
+	}
+
+	// Attached processes are not our children, so we cannot wait for them to stop, and we should not
+	// move them from the cgroups of whoever launched them
+	attacher_ptr_t attacher;
+	if (!attachlist.empty())
+	{
+		if (pause_mode != PauseMode::none)
+			LOGFAT("Attached processes can only be monitored with '--pause-mode none'");
+		try
+		{
+			attacher = std::make_shared<Attacher>(attachlist);
+		}
+		catch (const std::exception &e)
+		{
+			LOGFAT(e.what());
+		}
+	}
+	else if (tasklist.empty() && pending.empty())
+	{
+		LOGFAT("The config has no tasks to launch or attach to");
+	}
 
 	// Set CPU affinity for not interfering with the executed workloads
 	set_cpu_affinity(options.cpu_affinity);
 
+	// Threads for collecting the counters, they inherit the affinity of the manager
+	WorkerPool pool(std::max(options.collect_threads, 1U), options.cpu_affinity);
+
+	// The outputs that go to stdout when no file is given are kept in memory until the end, they don't need it
+	async_writer_ptr_t writer;
+	if (options.async_output)
+	{
+		if (options.output_flush < 0)
+			LOGFAT("The output flush time cannot be negative");
+		writer = std::make_shared<AsyncWriter>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(options.output_flush)));
+		int_out = writer->wrap(int_out);
+		if (binout_out)
+			binout_out = writer->wrap(binout_out);
+		if (vm["fin-output"].as<string>() != "")
+			ucompl_out = writer->wrap(ucompl_out);
+		if (vm["total-output"].as<string>() != "")
+			total_out = writer->wrap(total_out);
+		writer->start();
+		LOGINF("Output written from a separate thread, flushed every {} s"_format(options.output_flush));
+	}
+	binout_ptr_t binout;
+	if (binout_out)
+		binout = std::make_shared<BinaryOutput>(binout_out);
+
+	freezer_ptr_t freezer;
+	live_stats_ptr_t live;
 	try
 	{
 		// Initial CAT configuration. It may be modified by the CAT policy.
-		cat = cat_setup(options.cat_impl, coslist);
+		cat = cat_setup(options.cat_impl, coslist, options.cat_verify);
 		catpol->set_cat(cat);
+
+		// Live stats for external readers
+		if (vm["live-stats"].as<string>() != "")
+			live = std::make_shared<LiveStats>(vm["live-stats"].as<string>(), cat->get_max_closids());
+
+		// One cgroup per experiment, so several managers can share the machine
+		if (pause_mode == PauseMode::freezer)
+			freezer = std::make_shared<Freezer>("manager-{}"_format(vm["id"].as<string>()));
 	}
 	catch (const std::exception &e)
 	{
@@ -584,24 +1043,39 @@ int main(int argc, char *argv[])
 		LOGINF("Tasks ready");
 
 		// Setup events
+		perf.init();
 		for (const auto &task : tasklist)
 			perf.setup_events(task->pid, options.event);
 
 		// Start doing things
 		LOGINF("Start main loop");
 		if (setjmp(return_to_top_level) == 0)
-			loop(tasklist, sched, catpol, perf, options.event, options.ti * 1000 * 1000, options.mi, *int_out, *ucompl_out, *total_out);
+			loop(tasklist, pending, sched, catpol, perf, pool, options.event, options.ti * 1000 * 1000, options.mi, options.pipeline, pause_mode, freezer, attacher, limiter, overhead, binout, live, *int_out, *ucompl_out, *total_out);
 		else
-			clean_and_die(tasklist, catpol->get_cat(), perf);
+		{
+			// The decision thread may still be writing into the output streams
+			if (const auto decision = running_decision.lock())
+				decision->stop();
+			if (writer)
+				writer->close();
+			// The loop keeps references to it, so it would not be destroyed
+			if (live)
+				live->remove();
+			clean_and_die(tasklist, catpol->get_cat(), perf, freezer);
+		}
 		// Leaving consistent state after throwing signal
 		//int val = setjmp (return_to_top_level);
 		//LOGWAR("val = {}"_format(val));
 		//if (val)
-		//	clean_and_die(tasklist, catpol->get_cat(), perf);
+		//	clean_and_die(tasklist, catpol->get_cat(), perf, freezer);
 
 
 		// Kill tasks, reset CAT, performance monitors, etc...
-		clean(tasklist, catpol->get_cat(), perf);
+		clean(tasklist, catpol->get_cat(), perf, freezer);
+
+		// Everything has to be written before printing the final stats to stdout
+		if (writer)
+			writer->close();
 
 		// If no --fin-output argument, then the final stats are buffered in a stringstream and then outputted to stdout.
 		// If we don't do this and the normal output also goes to stdout, they would mix.
@@ -624,6 +1098,10 @@ int main(int argc, char *argv[])
 			LOGERR(e.what() << std::endl << *st);
 		else
 			LOGERR(e.what());
-		clean_and_die(tasklist, catpol->get_cat(), perf);
+		if (writer)
+			writer->close();
+		if (live)
+			live->remove();
+		clean_and_die(tasklist, catpol->get_cat(), perf, freezer);
 	}
 }
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "overhead.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace chr = std::chrono;
+
+using std::string;
+using fmt::literals::operator""_format;
+
+
+const string stage_to_str(Stage stage)
+{
+	switch (stage)
+	{
+		case Stage::resume:
+			return "resume";
+		case Stage::sleep:
+			return "sleep";
+		case Stage::pause:
+			return "pause";
+		case Stage::read:
+			return "read";
+		case Stage::accum:
+			return "accum";
+		case Stage::output:
+			return "output";
+		case Stage::sched:
+			return "sched";
+		case Stage::catpol:
+			return "catpol";
+		case Stage::count:
+			break;
+	}
+	throw_with_trace(std::runtime_error("Unknown stage, should not reach this"));
+}
+
+
+// Fractional microseconds, reading the counters of a task can take less than one
+static
+double us(chr::nanoseconds ns)
+{
+	return ns.count() / 1000.0;
+}
+
+
+// Nearest rank percentile, the samples must be sorted
+static
+chr::nanoseconds percentile(const std::vector<chr::nanoseconds> &sorted, double p)
+{
+	assert(!sorted.empty());
+	size_t rank = std::ceil(p / 100 * sorted.size());
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+
+Overhead::Overhead(std::shared_ptr<std::ostream> _out) : out(_out) {}
+
+
+void Overhead::print_headers()
+{
+	if (out)
+		*out << "interval,stage,samples,total_us,p50_us,p99_us,max_us" << std::endl;
+}
+
+
+void Overhead::record(uint32_t interval, Stage stage, chr::nanoseconds duration)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	pending[interval][size_t(stage)].push_back(duration);
+}
+
+
+void Overhead::begin_tasks(size_t num_tasks)
+{
+	task_read.assign(num_tasks, chr::nanoseconds(0));
+	task_accum.assign(num_tasks, chr::nanoseconds(0));
+}
+
+
+void Overhead::record_task(size_t i, Stage stage, chr::nanoseconds duration)
+{
+	// Each worker only touches its own slots, no locking needed
+	switch (stage)
+	{
+		case Stage::read:
+			task_read.at(i) = duration;
+			break;
+		case Stage::accum:
+			task_accum.at(i) = duration;
+			break;
+		default:
+			throw_with_trace(std::runtime_error("Stage '{}' is not a per-task stage"_format(stage_to_str(stage))));
+	}
+}
+
+
+void Overhead::end_tasks(uint32_t interval)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto &samples = pending[interval];
+	auto &read = samples[size_t(Stage::read)];
+	auto &accum = samples[size_t(Stage::accum)];
+	read.insert(read.end(), task_read.begin(), task_read.end());
+	accum.insert(accum.end(), task_accum.begin(), task_accum.end());
+}
+
+
+void Overhead::write(uint32_t interval, const samples_t &samples)
+{
+	for (size_t s = 0; s < samples.size(); s++)
+	{
+		auto sorted = samples[s];
+		if (sorted.empty())
+			continue;
+		std::sort(sorted.begin(), sorted.end());
+
+		auto &summary = total[s];
+		for (const auto &d : sorted)
+			summary.digest.add(us(d));
+		summary.max = std::max(summary.max, sorted.back());
+
+		if (!out)
+			continue;
+		chr::nanoseconds sum(0);
+		for (const auto &d : sorted)
+			sum += d;
+		*out << interval << "," << stage_to_str(Stage(s)) << "," << sorted.size() << ","
+				<< us(sum) << "," << us(percentile(sorted, 50)) << ","
+				<< us(percentile(sorted, 99)) << "," << us(sorted.back()) << std::endl;
+	}
+}
+
+
+void Overhead::flush(uint32_t interval)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto end = pending.lower_bound(interval);
+	for (auto it = pending.begin(); it != end; ++it)
+		write(it->first, it->second);
+	pending.erase(pending.begin(), end);
+}
+
+
+void Overhead::flush_all()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const auto &item : pending)
+		write(item.first, item.second);
+	pending.clear();
+}
+
+
+void Overhead::log_summary() const
+{
+	for (size_t s = 0; s < total.size(); s++)
+	{
+		const auto &summary = total[s];
+		if (!summary.digest.count())
+			continue;
+		LOGINF("[OVERHEAD] Stage {}: {} samples, p50 {} us, p99 {} us, max {} us"_format(
+				stage_to_str(Stage(s)), (uint64_t) summary.digest.count(), summary.digest.quantile(0.5),
+				summary.digest.quantile(0.99), us(summary.max)));
+	}
+}
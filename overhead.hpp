@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "quantile-sketch.hpp"
+#include "sampling-clock.hpp"
+
+
+// Stages of the main loop whose duration is measured
+enum class Stage
+{
+	resume, // Resuming or thawing the tasks
+	sleep,  // Waiting for the sampling clock
+	pause,  // Pausing or freezing the tasks and checking if they have exited
+	read,   // Reading the counters of a task
+	accum,  // Accumulating the counters of a task into its stats
+	output, // Printing the interval stats
+	sched,  // sched->apply
+	catpol, // catpol->apply
+	count
+};
+const std::string stage_to_str(Stage stage);
+
+
+// Collects the duration of the stages of the main loop. The stages of each interval are summarized
+// with their p50, p99 and max, and written as CSV rows to the overhead output (if any). The whole
+// execution is summarized with a t-digest per stage, so memory does not grow with the number of intervals.
+//
+// Stages can be recorded from the sampling and the decision threads. Worker threads record into
+// per-task slots that are preallocated by the sampling thread with 'begin_tasks'.
+class Overhead
+{
+	typedef std::array<std::vector<std::chrono::nanoseconds>, size_t(Stage::count)> samples_t;
+
+	struct Summary
+	{
+		TDigest digest; // In microseconds
+		std::chrono::nanoseconds max = std::chrono::nanoseconds(0);
+	};
+
+	std::shared_ptr<std::ostream> out;
+
+	std::mutex mutex;
+	std::map<uint32_t, samples_t> pending; // Intervals that have not been written yet
+	std::array<Summary, size_t(Stage::count)> total; // Every sample, for the summary at the end
+
+	// Per-task slots for the worker threads
+	std::vector<std::chrono::nanoseconds> task_read;
+	std::vector<std::chrono::nanoseconds> task_accum;
+
+	void write(uint32_t interval, const samples_t &samples);
+
+	public:
+
+	Overhead(std::shared_ptr<std::ostream> _out = nullptr);
+
+	Overhead(const Overhead&) = delete;
+	Overhead& operator=(const Overhead&) = delete;
+
+	void print_headers();
+
+	void record(uint32_t interval, Stage stage, std::chrono::nanoseconds duration);
+
+	// Per-task stages, recorded in parallel by the worker threads
+	void begin_tasks(size_t num_tasks);
+	void record_task(size_t i, Stage stage, std::chrono::nanoseconds duration);
+	void end_tasks(uint32_t interval);
+
+	// Write all the intervals up to 'interval' (not included). The caller guarantees that nobody is
+	// going to record more stages for them.
+	void flush(uint32_t interval);
+	void flush_all();
+
+	// Log p50, p99 and max of every stage during the whole execution
+	void log_summary() const;
+};
+
+
+// Records the time from its construction to its destruction
+class StageTimer
+{
+	Overhead &overhead;
+	const uint32_t interval;
+	const Stage stage;
+	const mono_time_t start;
+
+	public:
+
+	StageTimer(Overhead &_overhead, uint32_t _interval, Stage _stage) :
+		overhead(_overhead), interval(_interval), stage(_stage), start(mono_clock_t::now()) {}
+	~StageTimer() { overhead.record(interval, stage, mono_clock_t::now() - start); }
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+};
@@ -0,0 +1,155 @@
+#include <cerrno>
+#include <cstring>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "pipeline.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+static
+void eventfd_signal(int fd)
+{
+	uint64_t one = 1;
+	while (write(fd, &one, sizeof(one)) < 0)
+		if (errno != EINTR)
+			throw_with_trace(std::runtime_error("Could not write eventfd: {}"_format(strerror(errno))));
+}
+
+
+// Block until the eventfd is signaled
+static
+void eventfd_wait(int fd)
+{
+	uint64_t count;
+	while (read(fd, &count, sizeof(count)) < 0)
+		if (errno != EINTR)
+			throw_with_trace(std::runtime_error("Could not read eventfd: {}"_format(strerror(errno))));
+}
+
+
+DecisionStage::DecisionStage(decide_t _decide, bool _threaded) :
+		decide(_decide), threaded(_threaded), processed(0)
+{
+	if (!threaded)
+		return;
+
+	work_fd = eventfd(0, EFD_CLOEXEC);
+	done_fd = eventfd(0, EFD_CLOEXEC);
+	if (work_fd < 0 || done_fd < 0)
+		throw_with_trace(std::runtime_error("Could not create eventfd: {}"_format(strerror(errno))));
+
+	thread = std::thread(&DecisionStage::run, this);
+}
+
+
+DecisionStage::~DecisionStage()
+{
+	try
+	{
+		stop();
+	}
+	catch (const std::exception &e)
+	{
+		LOGERR("Could not stop the decision stage: {}"_format(e.what()));
+	}
+
+	if (work_fd >= 0)
+		close(work_fd);
+	if (done_fd >= 0)
+		close(done_fd);
+}
+
+
+void DecisionStage::stop()
+{
+	if (!thread.joinable())
+		return;
+
+	IntervalSnapshot quit;
+	quit.quit = true;
+	while (!ring.push(std::move(quit)))
+		eventfd_wait(done_fd);
+	eventfd_signal(work_fd);
+	thread.join();
+}
+
+
+void DecisionStage::run()
+{
+	// SIGINT must reach the sampling thread, that is the one that jumps to the cleanup code
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	IntervalSnapshot snapshot;
+	while (true)
+	{
+		eventfd_wait(work_fd);
+		while (ring.pop(snapshot))
+		{
+			if (snapshot.quit)
+				return;
+
+			// Once something has failed, the remaining snapshots are only acknowledged
+			if (!error)
+			{
+				try
+				{
+					decide(snapshot);
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+			}
+
+			// Release the tasks before telling the sampling thread that we are done
+			snapshot = IntervalSnapshot();
+			processed.fetch_add(1, std::memory_order_release);
+			eventfd_signal(done_fd);
+		}
+	}
+}
+
+
+void DecisionStage::submit(IntervalSnapshot &&snapshot)
+{
+	if (!threaded)
+	{
+		decide(snapshot);
+		return;
+	}
+
+	while (!ring.push(std::move(snapshot)))
+		eventfd_wait(done_fd);
+	submitted++;
+	eventfd_signal(work_fd);
+}
+
+
+void DecisionStage::wait()
+{
+	if (!threaded)
+		return;
+
+	while (processed.load(std::memory_order_acquire) < submitted)
+		eventfd_wait(done_fd);
+
+	if (error)
+	{
+		std::exception_ptr e;
+		std::swap(e, error);
+		std::rethrow_exception(e);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <thread>
+
+#include "spsc-ring.hpp"
+#include "task.hpp"
+
+
+// What the decision stage needs to know about an interval that has just been sampled
+struct IntervalSnapshot
+{
+	uint32_t interval = 0;
+	tasklist_t sampled;        // Tasks whose counters were read this interval, in output order
+	tasklist_t schedlist;      // Tasks selected to run during the next interval
+	bool apply_policy = false; // False for the last interval, that is only printed
+	bool quit = false;         // Tells the decision thread to finish
+};
+
+
+// Runs the decision and output work of each interval (printing the interval stats and applying
+// the CAT policy). When threaded, it runs in its own thread, fed with snapshots through a lock-free
+// ring, so the tasks can be resumed as soon as their counters have been read. If not, the work is
+// done synchronously by the sampling thread.
+//
+// The sampling thread must call 'wait' before touching the stats of the tasks again, so the two
+// stages never access the same data at the same time.
+class DecisionStage
+{
+	typedef std::function<void(const IntervalSnapshot &)> decide_t;
+
+	decide_t decide;
+	const bool threaded;
+
+	SPSCRing<IntervalSnapshot, 4> ring;
+	std::thread thread;
+	int work_fd = -1;   // Signaled by the sampling thread when there is a new snapshot
+	int done_fd = -1;   // Signaled by the decision thread when it finishes a snapshot
+
+	uint64_t submitted = 0;               // Only accessed by the sampling thread
+	std::atomic<uint64_t> processed;      // Snapshots completely processed
+	std::exception_ptr error;             // Written before 'processed' is updated
+
+	void run();
+
+	public:
+
+	DecisionStage() = delete;
+	DecisionStage(decide_t _decide, bool _threaded);
+	~DecisionStage();
+
+	DecisionStage(const DecisionStage&) = delete;
+	DecisionStage& operator=(const DecisionStage&) = delete;
+
+	// Hand over an interval to the decision stage
+	void submit(IntervalSnapshot &&snapshot);
+
+	// Wait until all the submitted intervals have been processed.
+	// Rethrows any exception thrown while processing them.
+	void wait();
+
+	// Process what has been submitted and finish the thread. Also needed when leaving the
+	// sampling loop without unwinding it (i.e. a signal), as the destructor never runs then.
+	void stop();
+
+	bool is_threaded() const { return threaded; }
+};
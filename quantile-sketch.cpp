@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <fmt/format.h>
+
+#include "quantile-sketch.hpp"
+#include "throw-with-trace.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+TDigest::TDigest(double _compression) :
+		compression(_compression),
+		buffer_size(5 * (size_t) std::ceil(_compression)),
+		min(std::numeric_limits<double>::infinity()),
+		max(-std::numeric_limits<double>::infinity())
+{
+	if (compression < 10)
+		throw_with_trace(std::runtime_error("The compression of a t-digest must be at least 10, not {}"_format(compression)));
+}
+
+
+void TDigest::add(double x, double weight)
+{
+	// A single infinity would turn every later merge into NaN
+	if (!std::isfinite(x) || weight <= 0)
+		return;
+	buffer.push_back({x, weight});
+	total += weight;
+	min = std::min(min, x);
+	max = std::max(max, x);
+	if (buffer.size() >= buffer_size)
+		compress();
+}
+
+
+void TDigest::merge(const TDigest &other)
+{
+	other.compress();
+	for (const auto &c : other.centroids)
+	{
+		buffer.push_back(c);
+		if (buffer.size() >= buffer_size)
+			compress();
+	}
+	total += other.total;
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+	compress();
+}
+
+
+void TDigest::clear()
+{
+	centroids.clear();
+	buffer.clear();
+	total = 0;
+	min = std::numeric_limits<double>::infinity();
+	max = -std::numeric_limits<double>::infinity();
+}
+
+
+// Merge the buffer into the centroids. A centroid grows while it spans less than one unit of the
+// scale function k(q) = compression / (2 pi) * asin(2q - 1), which is flat in the middle and steep
+// near q = 0 and q = 1.
+void TDigest::compress() const
+{
+	if (buffer.empty())
+		return;
+
+	buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+	std::sort(buffer.begin(), buffer.end(), [](const Centroid &a, const Centroid &b) { return a.mean < b.mean; });
+
+	double weight = 0;
+	for (const auto &c : buffer)
+		weight += c.weight;
+
+	auto k = [this](double q) { return compression / (2 * M_PI) * std::asin(2 * q - 1); };
+	auto k_inv = [this](double kq) { return (std::sin(kq * 2 * M_PI / compression) + 1) / 2; };
+
+	centroids.clear();
+	Centroid cur = buffer[0];
+	double done = 0; // Weight of the centroids already emitted
+	double q_limit = k_inv(k(0) + 1);
+	for (size_t i = 1; i < buffer.size(); i++)
+	{
+		const auto &c = buffer[i];
+		if ((done + cur.weight + c.weight) / weight <= q_limit)
+		{
+			cur.weight += c.weight;
+			cur.mean += (c.mean - cur.mean) * c.weight / cur.weight;
+		}
+		else
+		{
+			centroids.push_back(cur);
+			done += cur.weight;
+			// Past the last unit of k the limit is q = 1, k_inv would wrap around
+			double next = k(done / weight) + 1;
+			q_limit = next >= compression / 4 ? 1 : k_inv(next);
+			cur = c;
+		}
+	}
+	centroids.push_back(cur);
+	buffer.clear();
+}
+
+
+double TDigest::quantile(double q) const
+{
+	if (q < 0 || q > 1)
+		throw_with_trace(std::runtime_error("Invalid quantile {}, it must be between 0 and 1"_format(q)));
+	compress();
+	if (centroids.empty())
+		return NAN;
+	if (centroids.size() == 1)
+		return centroids[0].mean;
+
+	// Each centroid is placed at the middle of its weight, and the values are interpolated between them
+	double index = q * total;
+	const auto &first = centroids.front();
+	if (index < first.weight / 2)
+		return min + (first.mean - min) * index / (first.weight / 2);
+
+	double cum = 0;
+	for (size_t i = 0; i + 1 < centroids.size(); i++)
+	{
+		const auto &a = centroids[i];
+		const auto &b = centroids[i + 1];
+		double left = cum + a.weight / 2;
+		double right = cum + a.weight + b.weight / 2;
+		if (index <= right)
+			return a.mean + (b.mean - a.mean) * (index - left) / (right - left);
+		cum += a.weight;
+	}
+
+	const auto &last = centroids.back();
+	double left = total - last.weight / 2;
+	if (index >= total)
+		return max;
+	return last.mean + (max - last.mean) * (index - left) / (total - left);
+}
+
+
+WindowedTDigest::WindowedTDigest(size_t window, size_t num_buckets)
+{
+	if (!window || !num_buckets)
+		throw_with_trace(std::runtime_error("The window of a t-digest cannot be empty"));
+	num_buckets = std::min(num_buckets, window);
+	bucket_len = (window + num_buckets - 1) / num_buckets;
+	buckets.assign(num_buckets, TDigest());
+}
+
+
+void WindowedTDigest::add(double x)
+{
+	auto &bucket = buckets[(n / bucket_len) % buckets.size()];
+	if (n % bucket_len == 0)
+		bucket.clear();
+	bucket.add(x);
+	n++;
+}
+
+
+double WindowedTDigest::quantile(double q) const
+{
+	TDigest all;
+	for (const auto &bucket : buckets)
+		all.merge(bucket);
+	return all.quantile(q);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Approximate quantiles of a stream of values in constant memory (merging t-digest, by Dunning).
+// Values are buffered and merged into at most about 'compression' centroids, which are smaller near
+// the extremes, so the tail quantiles are more accurate than the median. Digests can be merged.
+class TDigest
+{
+	struct Centroid
+	{
+		double mean;
+		double weight;
+	};
+
+	double compression;
+	size_t buffer_size;
+
+	// Queries merge the buffer first, which does not change the result of any other query
+	mutable std::vector<Centroid> centroids; // Sorted by mean
+	mutable std::vector<Centroid> buffer;    // Not merged yet
+
+	double total = 0;
+	double min;
+	double max;
+
+	void compress() const;
+
+	public:
+
+	TDigest(double _compression = 100);
+
+	void add(double x, double weight = 1);
+	void merge(const TDigest &other);
+	void clear();
+
+	double count() const { return total; }
+
+	// Value below which there is a fraction q of the values, NaN if there are none
+	double quantile(double q) const;
+};
+
+
+// Quantiles of the last values of a stream. The window is divided in buckets, and the oldest one is
+// discarded as a whole, so it covers between (buckets - 1) * bucket_len and buckets * bucket_len values.
+class WindowedTDigest
+{
+	std::vector<TDigest> buckets;
+	size_t bucket_len;
+	uint64_t n = 0;
+
+	public:
+
+	WindowedTDigest(size_t window, size_t num_buckets = 10);
+
+	void add(double x);
+	double quantile(double q) const;
+};
+
+
+// Metrics whose quantiles are computed for each task, and length of the sliding window in intervals
+struct QuantileMetrics
+{
+	std::vector<std::string> names = {"ipc", "mpkil3", "intel_cqm/llc_occupancy/"};
+	bool required = false; // The default metrics are skipped if a task does not have them
+	uint32_t window = 100;
+};
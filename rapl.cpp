@@ -0,0 +1,221 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <regex>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "log.hpp"
+#include "rapl.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace fs = boost::filesystem;
+
+using fmt::literals::operator""_format;
+
+
+static
+uint64_t pread_uint64(int fd, const std::string &what)
+{
+	char buf[32];
+	ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (n <= 0)
+		throw_with_trace(std::runtime_error("Could not read {}: {}"_format(what, n < 0 ? strerror(errno) : "empty file")));
+	buf[n] = '\0';
+	return strtoull(buf, NULL, 10);
+}
+
+
+std::string rapl_kind_to_str(Rapl::Kind kind)
+{
+	switch (kind)
+	{
+		case Rapl::Kind::package:
+			return "package";
+		case Rapl::Kind::dram:
+			return "dram";
+		case Rapl::Kind::core:
+			return "core";
+		case Rapl::Kind::uncore:
+			return "uncore";
+		case Rapl::Kind::psys:
+			return "psys";
+		default:
+			throw_with_trace(std::runtime_error("Unknown RAPL domain kind"));
+	}
+}
+
+
+Rapl::Rapl(const std::string &root)
+{
+	// Zones are intel-rapl:<n>, with their subzones intel-rapl:<n>:<m> inside
+	const std::regex zone_re("intel-rapl:[0-9]+");
+	const std::regex subzone_re("intel-rapl:[0-9]+:[0-9]+");
+
+	if (fs::exists(root))
+	{
+		for (const auto &zone : fs::directory_iterator(root))
+		{
+			if (!std::regex_match(zone.path().filename().string(), zone_re))
+				continue;
+
+			std::string name;
+			open_ifstream(zone.path() / "name") >> name;
+			int parent = add(zone.path().string(), name, -1);
+
+			for (const auto &subzone : fs::directory_iterator(zone.path()))
+			{
+				if (!std::regex_match(subzone.path().filename().string(), subzone_re))
+					continue;
+				open_ifstream(subzone.path() / "name") >> name;
+				add(subzone.path().string(), name, parent);
+			}
+		}
+	}
+	if (domains.empty())
+		LOGWAR("No RAPL domains found in '{}', energy will be reported as 0"_format(root));
+
+	// Package of every cpu
+	const std::regex cpu_re("cpu([0-9]+)");
+	for (const auto &entry : fs::directory_iterator("/sys/devices/system/cpu"))
+	{
+		std::smatch m;
+		const auto name = entry.path().filename().string();
+		const auto path = entry.path() / "topology" / "physical_package_id";
+		if (!std::regex_match(name, m, cpu_re) || !fs::exists(path))
+			continue;
+		size_t cpu = std::stoul(m[1]);
+		int package;
+		open_ifstream(path) >> package;
+		if (cpu >= cpu_package.size())
+			cpu_package.resize(cpu + 1, 0);
+		cpu_package[cpu] = package;
+	}
+
+	sample();
+}
+
+
+Rapl::~Rapl()
+{
+	for (const auto &domain : domains)
+		if (domain.fd >= 0)
+			close(domain.fd);
+}
+
+
+// Subzones take the package and die of their parent zone, which is given by its position in 'domains'.
+// Returns the position of the domain, or -1 if it is not used.
+int Rapl::add(const std::string &dir, const std::string &name, int parent)
+{
+	Domain domain;
+	domain.dir = dir;
+	if (parent >= 0)
+	{
+		domain.package = domains[parent].package;
+		domain.die = domains[parent].die;
+	}
+
+	std::smatch m;
+	if (std::regex_match(name, m, std::regex("package-([0-9]+)(-die-([0-9]+))?")))
+	{
+		domain.kind = Kind::package;
+		domain.package = std::stoi(m[1]);
+		if (m[3].matched)
+			domain.die = std::stoi(m[3]);
+	}
+	else if (name == "dram")
+		domain.kind = Kind::dram;
+	else if (name == "core")
+		domain.kind = Kind::core;
+	else if (name == "uncore")
+		domain.kind = Kind::uncore;
+	else if (name == "psys")
+		domain.kind = Kind::psys;
+	else
+	{
+		LOGWAR("Unknown RAPL domain '{}' in '{}', ignoring it"_format(name, dir));
+		return -1;
+	}
+
+	if (domain.kind != Kind::package && domain.kind != Kind::psys && domain.package < 0)
+	{
+		LOGWAR("RAPL domain '{}' in '{}' does not belong to a package, ignoring it"_format(name, dir));
+		return -1;
+	}
+
+	open_ifstream(dir + "/max_energy_range_uj") >> domain.max_uj;
+
+	const auto path = dir + "/energy_uj";
+	domain.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (domain.fd < 0)
+		throw_with_trace(std::runtime_error("Could not open '{}': {}"_format(path, strerror(errno))));
+	domain.last_uj = pread_uint64(domain.fd, path);
+	domain.total_uj = domain.last_uj;
+
+	int pos = domains.size();
+	if (domain.kind == Kind::psys)
+		psys = pos;
+	else
+	{
+		if ((size_t) domain.package >= index.size())
+			index.resize(domain.package + 1);
+		index[domain.package][(size_t) domain.kind].push_back(pos);
+	}
+
+	LOGINF("RAPL domain '{}' of package {} die {} found in '{}'"_format(rapl_kind_to_str(domain.kind), domain.package, domain.die, dir));
+	domains.push_back(std::move(domain));
+	return pos;
+}
+
+
+void Rapl::sample(Domain &domain)
+{
+	uint64_t curr = pread_uint64(domain.fd, "'{}/energy_uj'"_format(domain.dir));
+
+	// The counter wraps around at max_energy_range_uj
+	uint64_t delta = (curr >= domain.last_uj) ?
+			curr - domain.last_uj :
+			curr + (domain.max_uj - domain.last_uj);
+	if (curr < domain.last_uj)
+		LOGDEB("Energy counter '{}' wrapped around"_format(domain.dir));
+
+	domain.total_uj += delta;
+	domain.last_uj = curr;
+	LOGDEB("{} energy of package {}: {} uj"_format(rapl_kind_to_str(domain.kind), domain.package, domain.total_uj));
+}
+
+
+void Rapl::sample()
+{
+	for (auto &domain : domains)
+		sample(domain);
+}
+
+
+int Rapl::get_package(int cpu) const
+{
+	if (cpu < 0 || (size_t) cpu >= cpu_package.size())
+		return 0;
+	return cpu_package[cpu];
+}
+
+
+uint64_t Rapl::get_uj(Kind kind, int package) const
+{
+	if (kind == Kind::psys)
+		return psys < 0 ? 0 : domains[psys].total_uj;
+	if (package < 0 || (size_t) package >= index.size())
+		return 0;
+
+	uint64_t total = 0;
+	for (int pos : index[package][(size_t) kind])
+		total += domains[pos].total_uj;
+	return total;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Energy counters of the RAPL interface, read through powercap.
+// The domains of all the packages are discovered at startup. Their files are opened once and read
+// with a single pread per sample, so the energy is read once per interval and shared by all the
+// tasks, instead of being read for every one of them. On multi-die parts every die has its own zone
+// (package-N-die-M), and the energy of the dies is added up by package.
+class Rapl
+{
+	public:
+
+	enum class Kind {package, dram, core, uncore, psys, count};
+
+	private:
+
+	struct Domain
+	{
+		Kind kind;
+		int package = -1;      // -1 for psys, which covers the whole platform
+		int die = 0;
+		std::string dir;
+		int fd = -1;           // energy_uj
+		uint64_t max_uj = 0;   // max_energy_range_uj, the counter wraps around when it reaches it
+		uint64_t last_uj = 0;  // Last raw reading
+		uint64_t total_uj = 0; // Energy since the first reading, plus the first reading, without wraparounds
+	};
+
+	std::vector<Domain> domains;
+	std::vector<std::array<std::vector<int>, (size_t) Kind::count>> index; // Positions in 'domains' by package and kind, one per die
+	int psys = -1;
+	std::vector<int> cpu_package; // Package of every cpu
+
+	int add(const std::string &dir, const std::string &name, int parent);
+	void sample(Domain &domain);
+
+	public:
+
+	Rapl(const std::string &root = "/sys/class/powercap");
+	~Rapl();
+
+	Rapl(const Rapl&) = delete;
+	Rapl& operator=(const Rapl&) = delete;
+
+	// Read the energy counters. Must not be called while other threads are getting the energy.
+	void sample();
+
+	size_t get_num_packages() const { return index.size(); }
+
+	// Package of a cpu, 0 if it is not known
+	int get_package(int cpu) const;
+
+	// Energy in microjoules at the last sample, 0 if the domain does not exist.
+	// It never decreases, wraparounds are already accounted for. The package is ignored for psys.
+	uint64_t get_uj(Kind kind, int package) const;
+};
+typedef std::unique_ptr<Rapl> rapl_ptr_t;
+
+std::string rapl_kind_to_str(Rapl::Kind kind);
@@ -0,0 +1,136 @@
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "log.hpp"
+#include "sampling-clock.hpp"
+#include "throw-with-trace.hpp"
+
+
+namespace chr = std::chrono;
+
+using fmt::literals::operator""_format;
+
+
+static
+struct timespec to_timespec(chr::nanoseconds ns)
+{
+	struct timespec ts;
+	ts.tv_sec = ns.count() / 1000000000;
+	ts.tv_nsec = ns.count() % 1000000000;
+	return ts;
+}
+
+
+SamplingClock::SamplingClock(chr::nanoseconds _period) : period(_period)
+{
+	if (period.count() <= 0)
+		throw_with_trace(std::runtime_error("The period of the sampling clock must be positive"));
+
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (timer_fd < 0)
+		throw_with_trace(std::runtime_error("Could not create timerfd: {}"_format(strerror(errno))));
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		throw_with_trace(std::runtime_error("Could not create epoll instance: {}"_format(strerror(errno))));
+
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.fd = timer_fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) < 0)
+		throw_with_trace(std::runtime_error("Could not add the timerfd to the epoll set: {}"_format(strerror(errno))));
+}
+
+
+SamplingClock::~SamplingClock()
+{
+	if (epoll_fd >= 0)
+		close(epoll_fd);
+	if (timer_fd >= 0)
+		close(timer_fd);
+}
+
+
+void SamplingClock::watch(int fd, std::function<void()> callback)
+{
+	struct epoll_event ev = {};
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		throw_with_trace(std::runtime_error("Could not add fd {} to the epoll set: {}"_format(fd, strerror(errno))));
+	watched[fd] = callback;
+}
+
+
+void SamplingClock::start()
+{
+	origin = mono_clock_t::now();
+	last_tick = origin;
+	deadline = 0;
+
+	// Periodic timer with an absolute first expiration. The kernel keeps the cadence for us, so a
+	// late wake up does not delay the following deadlines.
+	struct itimerspec spec;
+	spec.it_value = to_timespec(origin.time_since_epoch() + period);
+	spec.it_interval = to_timespec(period);
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+		throw_with_trace(std::runtime_error("Could not arm the timerfd: {}"_format(strerror(errno))));
+
+	started = true;
+}
+
+
+SamplingClock::Tick SamplingClock::wait()
+{
+	assert(started);
+
+	uint64_t expirations = 0;
+	while (!expirations)
+	{
+		struct epoll_event ev;
+		int n = epoll_wait(epoll_fd, &ev, 1, -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw_with_trace(std::runtime_error("Error waiting for the sampling clock: {}"_format(strerror(errno))));
+		}
+		if (n == 0)
+			continue;
+
+		if (ev.data.fd != timer_fd)
+		{
+			watched.at(ev.data.fd)();
+			continue;
+		}
+		if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			throw_with_trace(std::runtime_error("Could not read the timerfd: {}"_format(strerror(errno))));
+		}
+	}
+
+	auto now = mono_clock_t::now();
+	deadline += expirations;
+
+	Tick tick;
+	tick.deadline = deadline;
+	tick.missed = expirations - 1;
+	tick.time = now;
+	tick.duration = now - last_tick;
+	tick.jitter = now - (origin + deadline * period);
+	last_tick = now;
+
+	if (tick.missed)
+		LOGWAR("The sampling clock missed {} deadline(s), the manager is taking longer than the interval"_format(tick.missed));
+
+	return tick;
+}
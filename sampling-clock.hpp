@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+
+
+// The steady clock is CLOCK_MONOTONIC in Linux, the same clock used by the timerfd
+typedef std::chrono::steady_clock mono_clock_t;
+typedef mono_clock_t::time_point mono_time_t;
+
+
+// Periodic clock that drives the main loop. Deadlines are absolute (start + k * period), so the
+// time spent by the manager doing its work does not make the intervals drift.
+class SamplingClock
+{
+	int timer_fd = -1;
+	int epoll_fd = -1;
+
+	std::chrono::nanoseconds period;
+
+	mono_time_t origin;     // Time at which the clock was started
+	mono_time_t last_tick;  // Time at which the last call to 'wait' returned
+	uint64_t deadline = 0;  // Number of deadlines elapsed since the clock was started
+	bool started = false;
+
+	std::map<int, std::function<void()>> watched; // Other fds to attend while waiting
+
+	public:
+
+	struct Tick
+	{
+		uint64_t deadline;                 // Index of the deadline that woke us up
+		uint64_t missed;                   // Deadlines that expired without anyone waiting for them
+		mono_time_t time;                  // Time at which we woke up
+		std::chrono::nanoseconds duration; // Measured time since the previous tick (or the start)
+		std::chrono::nanoseconds jitter;   // Delay between the deadline and the wake up
+	};
+
+	SamplingClock() = delete;
+	SamplingClock(std::chrono::nanoseconds _period);
+	~SamplingClock();
+
+	// Non copyable, it owns file descriptors
+	SamplingClock(const SamplingClock&) = delete;
+	SamplingClock& operator=(const SamplingClock&) = delete;
+
+	// Arm the timer, the first deadline will be one period from now
+	void start();
+
+	// Block until the next deadline
+	Tick wait();
+
+	// Call 'callback' from 'wait' whenever 'fd' becomes readable, without waking up the caller
+	void watch(int fd, std::function<void()> callback);
+
+	mono_time_t get_origin() const { return origin; }
+	std::chrono::nanoseconds get_period() const { return period; }
+};
+
+
+// Nanoseconds to microseconds, for logging
+inline int64_t to_us(std::chrono::nanoseconds ns)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(ns).count();
+}
@@ -0,0 +1,102 @@
+import argparse
+import numpy as np
+import pandas as pd
+import struct
+import sys
+
+
+MAGIC = b'CPABIN\0\0'
+VERSION = 1
+CHUNK_SCHEMA = 1
+CHUNK_APPS = 2
+CHUNK_RECORDS = 3
+
+
+def read(path):
+    """Reads the binary output of the manager (--binary-output).
+
+    Returns a list with a structured numpy array per records chunk, with a field per column, and a
+    dict from app id to name. Records are not copied, the arrays are views of the memory mapped file,
+    so they can be processed one at a time. A chunk that is still being written is ignored.
+    """
+    data = np.memmap(path, dtype=np.uint8, mode='r')
+    if len(data) < 16 or bytes(data[:8]) != MAGIC:
+        raise ValueError("'{}' is not a binary output file".format(path))
+    version, = struct.unpack_from('<I', data, 8)
+    if version != VERSION:
+        raise ValueError("'{}' has version {} of the binary output, expected {}".format(path, version, VERSION))
+
+    dtype = None
+    apps = {}
+    records = []
+    pos = 16
+    while pos + 16 <= len(data):
+        kind, _, size = struct.unpack_from('<IIQ', data, pos)
+        pos += 16
+        if pos + size > len(data):
+            break
+        payload = data[pos:pos + size]
+        pos += size
+
+        if kind == CHUNK_SCHEMA:
+            ncols, record_size = struct.unpack_from('<II', payload, 0)
+            p = 8
+            fields = []
+            for _ in range(ncols):
+                name = bytes(payload[p + 1:p + 1 + payload[p]]).decode()
+                p += 1 + payload[p]
+                typ = bytes(payload[p + 1:p + 1 + payload[p]]).decode()
+                p += 1 + payload[p]
+                fields.append((name, typ))
+            dtype = np.dtype(fields)
+            assert dtype.itemsize == record_size
+        elif kind == CHUNK_APPS:
+            count, = struct.unpack_from('<I', payload, 0)
+            p = 4
+            for _ in range(count):
+                app, length = struct.unpack_from('<IH', payload, p)
+                p += 6
+                apps[app] = bytes(payload[p:p + length]).decode()
+                p += length
+        elif kind == CHUNK_RECORDS:
+            if dtype is None:
+                raise ValueError("Records without a schema in '{}'".format(path))
+            records.append(np.frombuffer(payload, dtype=dtype))
+
+    if dtype is None:
+        raise ValueError("'{}' has no schema".format(path))
+    if not records:
+        records.append(np.empty(0, dtype=dtype))
+    return records, apps
+
+
+def chunk_to_dataframe(records, apps):
+    """Same layout as the text output of the manager: interval, app, CPU, compl and the stats."""
+    df = pd.DataFrame({name: records[name] for name in records.dtype.names if name != '_pad'})
+    df['app'] = ["{:02d}_{}".format(a, apps.get(a, '')) for a in records['app']]
+    return df
+
+
+def to_dataframe(path):
+    """Loads the whole file in a single dataframe, see chunk_to_dataframe."""
+    records, apps = read(path)
+    return chunk_to_dataframe(np.concatenate(records), apps)
+
+
+def main():
+    parser = argparse.ArgumentParser(description = 'Converts the binary output of the manager to CSV.')
+    parser.add_argument('input', help='Binary output file.')
+    parser.add_argument('-o', '--output', default=None, help='CSV file, defaults to stdout.')
+    args = parser.parse_args()
+
+    # One chunk at a time, the file can be larger than the memory
+    records, apps = read(args.input)
+    out = open(args.output, 'w') if args.output else sys.stdout
+    for i, chunk in enumerate(records):
+        chunk_to_dataframe(chunk, apps).to_csv(out, index=False, header=(i == 0))
+    if args.output:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
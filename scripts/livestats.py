@@ -0,0 +1,129 @@
+import argparse
+import json
+import math
+import mmap
+import os
+import struct
+import sys
+import time
+
+
+MAGIC = b'CPALIVE\0'
+VERSION = 1
+HEADER = struct.Struct('<8sIiQIIIIQqII')
+TASK = struct.Struct('<IiiI')
+
+
+def alive(pid):
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        pass
+    return True
+
+
+def read(name, retries=1000):
+    """Reads the live stats published by the manager (--live-stats) in /dev/shm/<name>.
+
+    Returns a dict with the interval, the time, the CLOS masks and a list of tasks with their stats.
+    The segment is copied and the copy is retried while the manager is writing it.
+    """
+    with open("/dev/shm/" + name, 'rb') as f:
+        mem = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+    try:
+        for _ in range(retries):
+            seq1 = struct.unpack_from('<Q', mem, 16)[0]
+            if seq1 % 2:
+                time.sleep(0.0001)
+                continue
+            data = mem[:]
+            seq2 = struct.unpack_from('<Q', mem, 16)[0]
+            if seq1 == seq2:
+                return parse(data)
+        raise RuntimeError("The live stats '{}' are always being written".format(name))
+    finally:
+        mem.close()
+
+
+def parse(data):
+    (magic, version, pid, seq, ncols, max_tasks, ntasks, nclos, interval, time_ns,
+            name_size, task_size) = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("Not a live stats segment, or not initialized yet")
+    if version != VERSION:
+        raise ValueError("Version {} of the live stats, expected {}".format(version, VERSION))
+
+    pos = HEADER.size
+    columns = []
+    for _ in range(ncols):
+        columns.append(data[pos:pos + name_size].split(b'\0', 1)[0].decode())
+        pos += name_size
+    masks = list(struct.unpack_from('<{}Q'.format(nclos), data, pos))
+    pos += 8 * nclos
+
+    tasks = []
+    values = struct.Struct('<{}d'.format(1 + ncols))
+    for i in range(ntasks):
+        rec = pos + i * task_size
+        tid, tpid, cpu, _ = TASK.unpack_from(data, rec)
+        tname = data[rec + TASK.size:rec + TASK.size + name_size].split(b'\0', 1)[0].decode()
+        vals = values.unpack_from(data, rec + TASK.size + name_size)
+        task = {"id": tid, "name": tname, "pid": tpid, "CPU": cpu, "compl": vals[0]}
+        task.update(zip(columns, vals[1:]))
+        tasks.append(task)
+
+    return {
+        "pid": pid,
+        "alive": alive(pid),
+        "interval": interval,
+        "time": time_ns / 1e9,
+        "clos_masks": ["{:#x}".format(m) for m in masks],
+        "tasks": tasks,
+    }
+
+
+def print_table(stats, columns):
+    print("interval {} ({}){}".format(stats["interval"], time.strftime('%H:%M:%S', time.localtime(stats["time"])),
+            "" if stats["alive"] else " - the manager is not running"))
+    print("CLOS masks: {}".format(" ".join(stats["clos_masks"])))
+    if not stats["tasks"]:
+        return
+    columns = columns or [c for c in stats["tasks"][0] if c not in ("id", "name", "pid")]
+    print(",".join(["app"] + columns))
+    for task in stats["tasks"]:
+        print(",".join(["{:02d}_{}".format(task["id"], task["name"])] + ["{}".format(task.get(c, "")) for c in columns]))
+
+
+def to_json(stats):
+    """NaN and infinity are not valid JSON, the stats that have no value (i.e. compl without a limit of instructions) are written as null."""
+    def value(v):
+        return None if isinstance(v, float) and not math.isfinite(v) else v
+    stats = dict(stats)
+    stats["tasks"] = [{k: value(v) for k, v in task.items()} for task in stats["tasks"]]
+    return json.dumps(stats, allow_nan=False)
+
+
+def main():
+    parser = argparse.ArgumentParser(description = 'Shows the live stats published by a running manager.')
+    parser.add_argument('name', help='Name of the shared memory segment (--live-stats of the manager).')
+    parser.add_argument('-c', '--columns', nargs='+', default=None, help='Columns to show, all by default.')
+    parser.add_argument('-w', '--watch', type=float, default=0, help='Show the stats every WATCH seconds.')
+    parser.add_argument('--json', action='store_true', help='Print JSON, one object per line.')
+    args = parser.parse_args()
+
+    while True:
+        stats = read(args.name)
+        if args.json:
+            print(to_json(stats))
+        else:
+            print_table(stats, args.columns)
+        sys.stdout.flush()
+        if not args.watch or not stats["alive"]:
+            break
+        time.sleep(args.watch)
+
+
+if __name__ == "__main__":
+    main()
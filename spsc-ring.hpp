@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+
+// Lock-free ring buffer for exactly one producer thread and one consumer thread.
+// The capacity must be a power of two.
+template <typename T, size_t N>
+class SPSCRing
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "The capacity of the ring must be a power of two");
+
+	std::array<T, N> slots;
+
+	// Head and tail are written by different threads, keep them in different cache lines
+	alignas(64) std::atomic<size_t> head; // Next slot to read, written by the consumer
+	alignas(64) std::atomic<size_t> tail; // Next slot to write, written by the producer
+
+	public:
+
+	SPSCRing() : head(0), tail(0) {}
+
+	SPSCRing(const SPSCRing&) = delete;
+	SPSCRing& operator=(const SPSCRing&) = delete;
+
+	// Producer side. Returns false if the ring is full.
+	bool push(T &&item)
+	{
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N)
+			return false;
+		slots[t & (N - 1)] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns false if the ring is empty.
+	bool pop(T &item)
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (tail.load(std::memory_order_acquire) == h)
+			return false;
+		item = std::move(slots[h & (N - 1)]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+	static constexpr size_t capacity() { return N; }
+};
@@ -15,13 +15,13 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cmath>
 #include <functional>
-#include <iomanip>
+#include <map>
+#include <mutex>
 #include <sstream>
-#include <iostream>
-#include <iosfwd>
 
-#include <boost/io/ios_state.hpp>
 #include <fmt/format.h>
 
 #include "log.hpp"
@@ -30,70 +30,109 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
 #define WIN_SIZE 7
+#define HISTORY_SIZE 128 // Points kept at each resolution
 
 
-namespace acc = boost::accumulators;
+// Quantiles printed in the total output
+static const std::vector<std::pair<double, std::string>> output_quantiles = {{0.5, "p50"}, {0.95, "p95"}, {0.99, "p99"}};
+
 
 using fmt::literals::operator""_format;
 
 
+// Names of the metrics, shared by all the stats. Policies may resolve names from their own thread.
+static std::mutex registry_mutex;
+static std::map<std::string, metric_t> registry_ids;
+static std::vector<std::string> registry_names;
+
+
+metric_t Stats::metric(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	auto it = registry_ids.find(name);
+	if (it != registry_ids.end())
+		return it->second;
+	metric_t id = registry_names.size();
+	registry_ids[name] = id;
+	registry_names.push_back(name);
+	return id;
+}
+
+
+std::string Stats::metric_name(metric_t id)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	return registry_names.at(id);
+}
+
+
 Stats::Stats(const std::vector<std::string> &stats_names)
 {
 	init(stats_names);
 }
 
 
-void Stats::init_derived_metrics_total(const std::vector<std::string> &stats_names)
+static std::vector<DerivedMetric> user_derived_metrics;
+
+
+void Stats::define_derived_metrics(const std::vector<DerivedMetric> &metrics)
 {
-	bool instructions = std::find(stats_names.begin(), stats_names.end(), "instructions") != stats_names.end();
-	bool cycles = std::find(stats_names.begin(), stats_names.end(), "cycles") != stats_names.end();
-	bool ref_cycles = std::find(stats_names.begin(), stats_names.end(), "ref-cycles") != stats_names.end();
+	user_derived_metrics = metrics;
+}
 
-	if (instructions && cycles)
-	{
-		derived_metrics_total.push_back(std::make_pair("ipc", [this]()
-		{
-			double inst = this->sum("instructions");
-			double cycl = this->sum("cycles");
-			return inst / cycl;
-		}));
-	}
 
-	if (instructions && ref_cycles)
-	{
-		derived_metrics_total.push_back(std::make_pair("ref-ipc", [this]()
-		{
-			double inst = this->sum("instructions");
-			double ref_cycl = this->sum("ref-cycles");
-			return inst / ref_cycl;
-		}));
-	}
+static QuantileMetrics quantile_metrics;
+
+
+void Stats::define_quantile_metrics(const QuantileMetrics &metrics)
+{
+	quantile_metrics = metrics;
 }
 
 
-void Stats::init_derived_metrics_int(const std::vector<std::string> &stats_names)
+// Derived metrics are computed if their operands are counters or metrics derived before them.
+// Built-in metrics are skipped if they cannot be computed, but user metrics are required.
+void Stats::init_derived_metrics()
 {
-	bool instructions = std::find(stats_names.begin(), stats_names.end(), "instructions") != stats_names.end();
-	bool cycles = std::find(stats_names.begin(), stats_names.end(), "cycles") != stats_names.end();
-	bool ref_cycles = std::find(stats_names.begin(), stats_names.end(), "ref-cycles") != stats_names.end();
-	if (instructions && cycles)
+	static const std::vector<DerivedMetric> builtin =
 	{
-		derived_metrics_int.push_back(std::make_pair("ipc", [this]()
-		{
-			double inst = this->last("instructions");
-			double cycl = this->last("cycles");
-			return inst / cycl;
-		}));
-	}
+		{"ipc", "instructions / cycles", true},
+		{"ref-ipc", "instructions / {ref-cycles}", true},
+	};
 
-	if (instructions && ref_cycles)
+	auto available = ids;
+	auto defined = [&](metric_t id) { return std::find(available.begin(), available.end(), id) != available.end(); };
+
+	for (const auto list : std::initializer_list<const std::vector<DerivedMetric>*>{&builtin, &user_derived_metrics})
 	{
-		derived_metrics_int.push_back(std::make_pair("ref-ipc", [this]()
+		for (const auto &der : *list)
 		{
-			double inst = this->last("instructions");
-			double ref_cycl = this->last("ref-cycles");
-			return inst / ref_cycl;
-		}));
+			metric_t id = metric(der.name);
+
+			// User metrics replace built-in metrics with the same name
+			if (der.builtin && std::find_if(user_derived_metrics.begin(), user_derived_metrics.end(),
+					[&der](const auto &m) { return m.name == der.name; }) != user_derived_metrics.end())
+				continue;
+
+			if (defined(id))
+				throw_with_trace(std::runtime_error("Derived metric '{}' has the same name as another metric"_format(der.name)));
+
+			bool ok = true;
+			for (const auto op : der.expr.get_operands())
+			{
+				if (!defined(op))
+				{
+					if (!der.builtin)
+						throw_with_trace(std::runtime_error("Derived metric '{}' needs '{}', which is not monitored"_format(der.name, metric_name(op))));
+					ok = false;
+				}
+			}
+			if (!ok)
+				continue;
+
+			derived.push_back(std::make_pair(id, der.expr));
+			available.push_back(id);
+		}
 	}
 }
 
@@ -102,134 +141,228 @@ void Stats::init(const std::vector<std::string> &stats_names)
 {
 	assert(!initialized);
 
+	// Store the names of the counters
+	names = stats_names;
 	for (const auto &c : stats_names)
-		events.insert(std::make_pair(c, accum_t(acc::tag::rolling_window::window_size = WIN_SIZE)));
+		ids.push_back(metric(c));
+	clos_mask = metric("clos_mask");
+
+	init_derived_metrics();
+	for (const auto &der : derived)
+		ids.push_back(der.first);
+
+	// Room for all the handles known by now, ours are among them
+	width = *std::max_element(ids.begin(), ids.end()) + 1;
+	present.assign(width, false);
+	for (const auto id : ids)
+		present[id] = true;
+	v_last.assign(width, 0);
+	v_sum.assign(width, 0);
+	v_mean.assign(width, 0);
+	v_m2.assign(width, 0);
+
+	series = TimeSeries(ids.size(), HISTORY_SIZE);
+	column_pos.assign(width, -1);
+	for (size_t i = 0; i < ids.size(); i++)
+		column_pos[ids[i]] = i;
+	row.resize(ids.size());
+
+	init_quantiles();
+
+	initialized = true;
+}
 
-	init_derived_metrics_int(stats_names);
-	init_derived_metrics_total(stats_names);
 
-	// Test der metrics
-	if (derived_metrics_int.size() != derived_metrics_total.size())
-		throw_with_trace(std::runtime_error("Different number of derived metrics for int ({}) and total ({})"_format(
-				derived_metrics_int.size(), derived_metrics_total.size())));
-	for(const auto &der : derived_metrics_int)
+void Stats::init_quantiles()
+{
+	sketch_pos.assign(width, -1);
+	for (const auto &name : quantile_metrics.names)
 	{
-		auto it = std::find_if(derived_metrics_total.begin(), derived_metrics_total.end(),
-				[&der](const auto& tuple) {return tuple.first == der.first;});
-		if (it == derived_metrics_total.end())
-			throw_with_trace(std::runtime_error("Different derived metrics for int and total results"));
+		metric_t id = metric(name);
+		if (!has(id))
+		{
+			if (quantile_metrics.required)
+				throw_with_trace(std::runtime_error("Cannot compute the quantiles of '{}', which is not monitored"_format(name)));
+			continue;
+		}
+		if (sketch_pos[id] >= 0)
+			continue;
+		sketch_pos[id] = sketch_ids.size();
+		sketch_ids.push_back(id);
+		sketch_run.emplace_back();
+		sketch_window.emplace_back(quantile_metrics.window);
 	}
+}
 
-	for (const auto &der : derived_metrics_int)
-		events.insert(std::make_pair(der.first, accum_t(acc::tag::rolling_window::window_size = WIN_SIZE)));
 
-	// Store the names of the counters
-	names = stats_names;
+size_t Stats::sketch(metric_t id) const
+{
+	if (!has_quantiles(id))
+		throw_with_trace(std::runtime_error("The quantiles of '{}' are not computed"_format(metric_name(id))));
+	return sketch_pos[id];
+}
 
-	initialized = true;
+
+double Stats::quantile(metric_t id, double q) const
+{
+	return sketch_run[sketch(id)].quantile(q);
+}
+
+
+double Stats::rolling_quantile(metric_t id, double q) const
+{
+	return sketch_window[sketch(id)].quantile(q);
+}
+
+
+void Stats::check(metric_t id) const
+{
+	if (id >= width || !present[id])
+		throw_with_trace(std::runtime_error("Metric not monitorized '{}'"_format(metric_name(id))));
+}
+
+
+// Add a value to the metric, 'counter' is the index of the sample
+void Stats::push(metric_t id, double value)
+{
+	double n = counter + 1;
+	double delta = value - v_mean[id];
+
+	v_last[id] = value;
+	v_sum[id] += value;
+	v_mean[id] += delta / n;
+	v_m2[id] += delta * (value - v_mean[id]);
+}
+
+
+double Stats::variance(metric_t id) const
+{
+	check(id);
+	return counter ? v_m2[id] / counter : 0;
 }
 
 
-Stats& Stats::accum(const counters_t &counters)
+double Stats::rolling_mean(metric_t id) const
+{
+	return history_mean(id, WIN_SIZE);
+}
+
+
+// Match the counters of the snapshots with their handles, by name, only once
+void Stats::resolve(const CounterSnapshot &counters)
+{
+	table = counters.table;
+	counter_ids.clear();
+	counter_starts_at_zero.clear();
+	counter_pos.assign(width, -1);
+	for (size_t i = 0; i < counters.size(); i++)
+	{
+		const auto &name = counters.info(i).name;
+		metric_t id = metric(name);
+		if (id >= width || !present[id])
+			throw_with_trace(std::runtime_error("Counter '{}' has not been initialized"_format(name)));
+		counter_ids.push_back(id);
+		counter_pos[id] = i;
+		counter_starts_at_zero.push_back(name == "power/energy-ram/" || name == "power/energy-pkg/");
+	}
+}
+
+
+Stats& Stats::accum(const CounterSnapshot &counters, mono_time_t start, mono_time_t end)
 {
 	assert(initialized);
+	assert(end >= start);
+	assert(!counters.empty());
 
-	clast = ccurr;
-	ccurr = counters;
+	tstart = start;
+	tend = end;
+	elapsed += end - start;
 
-	const auto &last_id_idx = clast.get<by_id>();
-	auto &curr_id_idx = ccurr.get<by_id>();
+	if (counters.table != table)
+		resolve(counters);
+	assert(counter_ids.size() == counters.size());
 
-	assert(!ccurr.empty());
+	// The buffers are swapped and overwritten, so they are only allocated the first times
+	std::swap(clast, ccurr);
+	ccurr.assign(counters);
 
 	// App has just started, no last data
 	if (clast.empty())
 	{
-		auto it = curr_id_idx.cbegin();
-		while (it != curr_id_idx.cend())
+		for (size_t i = 0; i < ccurr.size(); i++)
 		{
-			double value = (it->name == "power/energy-ram/" || it->name == "power/energy-pkg/") ?
-					0 :
-					it->value;
+			double value = counter_starts_at_zero[i] ? 0 : ccurr.values[i];
 
-			assert(it->running >= 0 && it->running <= it->enabled);
+			assert(ccurr.running[i] <= ccurr.enabled[i]);
 
-			if (it->running)
-				value /= (double) it->running / (double) it->enabled;
+			if (ccurr.running[i])
+				value /= (double) ccurr.running[i] / (double) ccurr.enabled[i];
 
 			assert(std::isfinite(value));
-			events.at(it->name)(value);
-			it++;
+			push(counter_ids[i], value);
 		}
-		cbak = counters; // For being able to iterate them later
 	}
 
 	// We have data from the last interval
 	else
 	{
 		assert(ccurr.size() == clast.size());
-		auto curr_it = curr_id_idx.cbegin();
-		auto last_it = last_id_idx.cbegin();
-		while (curr_it != curr_id_idx.cend() && last_it != last_id_idx.cend())
+		assert(ccurr.table == clast.table);
+		for (size_t i = 0; i < ccurr.size(); i++)
 		{
-			const Counter &c = *curr_it;
-			const Counter &l = *last_it;
-			assert(c.id == l.id);
-			assert(c.name == l.name);
-			double value = c.snapshot ?
-					c.value :
-					c.value - l.value;
+			const auto &info = ccurr.info(i);
+			double value = info.snapshot ?
+					ccurr.values[i] :
+					ccurr.values[i] - clast.values[i];
 
+			// Energy wraparounds are already handled when sampling RAPL
 			if (value < 0)
-			{
-				// There has been an overflow with the energy, and we have to correct it
-				double newvalue = 0;
-				if (c.name == "power/energy-pkg/")
-					newvalue = c.value * 1E6 + (read_max_ujoules_pkg() - l.value * 1E6);
-				else if (c.name == "power/energy-ram/")
-					newvalue = c.value * 1E6 + (read_max_ujoules_ram() - l.value * 1E6);
-				else
-					throw_with_trace(std::runtime_error("Negative interval value ({}) for the counter '{}'"_format(value, c.name)));
-
-				newvalue /= 1E6;
-				LOGDEB("Energy counter '{}' overflow. Last interval value was {}. Current will be {}"_format(c.name, last(c.name), newvalue));
-				value = newvalue;
-			}
+				throw_with_trace(std::runtime_error("Negative interval value ({}) for the counter '{}'"_format(value, info.name)));
 
-			assert(c.enabled >= 0 && c.running <= c.enabled);
+			uint64_t enabled = ccurr.enabled[i];
+			uint64_t running = ccurr.running[i];
+			assert(running <= enabled);
 
-			double enabled_fraction = (double) c.running / (double) c.enabled;
-			if (c.enabled == 0)
-				LOGINF("Counter '{}' was not enabled during this interval"_format(c.name));
+			double enabled_fraction = (double) running / (double) enabled;
+			if (enabled == 0)
+				LOGINF("Counter '{}' was not enabled during this interval"_format(info.name));
 			else if (enabled_fraction < 1)
 			{
 				value /= enabled_fraction;
-				LOGDEB("Counter {} has been scaled ({})"_format(c.name, enabled_fraction));
+				LOGDEB("Counter {} has been scaled ({})"_format(info.name, enabled_fraction));
 			}
 			else
 			{
 				assert(enabled_fraction == 1);
-				LOGDEB("Counter {} has been read without scaling"_format(c.name));
+				LOGDEB("Counter {} has been read without scaling"_format(info.name));
 			}
 
 			assert(std::isfinite(value));
-			events.at(c.name)(value);
+			push(counter_ids[i], value);
 
 			// Perf reports events since the begining of the execution, but enabled and running times are for the interval.
 			// Therefore, in order to know the running and enabled times since the start we need to accumulate them.
-			curr_id_idx.modify(curr_it, [&l](auto &c_){c_.enabled += l.enabled; c_.running += l.running;});
+			ccurr.enabled[i] += clast.enabled[i];
+			ccurr.running[i] += clast.running[i];
 
 			// Check values of each counter
-			LOGDEB("Counter {} has value {}"_format(c.name,c.value));
-
-			curr_it++;
-			last_it++;
+			LOGDEB("Counter {} has value {}"_format(info.name, ccurr.values[i]));
 		}
 	}
 
-	// Compute and add derived metrics
-	for (const auto &der : derived_metrics_int)
-		events.at(der.first)(der.second());
+	// Compute and add derived metrics, they can use the ones computed before them
+	for (const auto &der : derived)
+		push(der.first, der.second.eval(v_last));
+
+	data_int(row.data());
+	series.append(row.data());
+
+	for (size_t i = 0; i < sketch_ids.size(); i++)
+	{
+		double value = v_last[sketch_ids[i]];
+		sketch_run[i].add(value);
+		sketch_window[i].add(value);
+	}
 
 	counter++;
 
@@ -237,6 +370,22 @@ Stats& Stats::accum(const counters_t &counters)
 }
 
 
+std::vector<std::string> Stats::column_names() const
+{
+	auto result = names;
+	for (const auto &der : derived)
+		result.push_back(metric_name(der.first));
+	return result;
+}
+
+
+void Stats::data_int(double *values) const
+{
+	for (size_t i = 0; i < ids.size(); i++)
+		values[i] = v_last[ids[i]];
+}
+
+
 std::string Stats::header_to_string(const std::string &sep) const
 {
 	if (!names.size()) return "";
@@ -247,8 +396,8 @@ std::string Stats::header_to_string(const std::string &sep) const
 	it++;
 	for (; it != names.end(); it++)
 		ss << sep << *it;
-	for (const auto &der : derived_metrics_int) // Int, snapshot and total have the same derived metrics
-		ss << sep << der.first;
+	for (const auto &der : derived) // Int and total have the same derived metrics
+		ss << sep << metric_name(der.first);
 	return ss.str();
 }
 
@@ -261,33 +410,63 @@ std::string Stats::data_to_string_total(const std::string &sep) const
 {
 	std::stringstream ss;
 
-	assert(cbak.size() > 0);
+	assert(table && table->size() > 0);
 
-	const auto &cbak_id_idx = cbak.get<by_id>();
-	auto it = cbak_id_idx.cbegin();
-	while (it != cbak_id_idx.cend())
+	for (size_t i = 0; i < table->size(); i++)
 	{
-		const auto &name = it->name;
-		const accum_t &event = events.at(name);
-		double value = it->snapshot ?
-				acc::mean(event) :
-				acc::sum(event);
-		ss << value;
-		it++;
-		if (it != cbak_id_idx.cend())
+		const auto &info = (*table)[i];
+		metric_t id = counter_ids[i];
+		double value = info.snapshot ?
+				v_mean[id] :
+				v_sum[id];
+		if (i > 0)
 			ss << sep;
+		ss << value;
 	}
 
-	// Derived metrics
-	for (auto it1 = derived_metrics_total.cbegin(); it1 != derived_metrics_total.cend(); it1++)
+	// Derived metrics are computed again from the totals
+	auto totals = v_sum;
+	for (const auto &der : derived)
 	{
-		double value = it1->second();
-		ss << sep << value;
+		totals[der.first] = der.second.eval(totals);
+		ss << sep << totals[der.first];
 	}
 
 	return ss.str();
 }
 
+std::string Stats::quantiles_header_to_string(const std::string &sep) const
+{
+	std::stringstream ss;
+	for (size_t i = 0; i < sketch_ids.size(); i++)
+	{
+		for (size_t j = 0; j < output_quantiles.size(); j++)
+		{
+			if (i > 0 || j > 0)
+				ss << sep;
+			ss << metric_name(sketch_ids[i]) << ":" << output_quantiles[j].second;
+		}
+	}
+	return ss.str();
+}
+
+
+std::string Stats::quantiles_to_string(const std::string &sep) const
+{
+	std::stringstream ss;
+	for (size_t i = 0; i < sketch_ids.size(); i++)
+	{
+		for (size_t j = 0; j < output_quantiles.size(); j++)
+		{
+			if (i > 0 || j > 0)
+				ss << sep;
+			ss << sketch_run[i].quantile(output_quantiles[j].first);
+		}
+	}
+	return ss.str();
+}
+
+
 std::string Stats::double2hexstr(double x) const
 {
    int int_x = (int) x;
@@ -304,60 +483,64 @@ std::string Stats::data_to_string_int(const std::string &sep) const
 
 	assert(names.size() > 0);
 
-	auto it1 = names.cbegin();
-	while (it1 != names.cend())
+	for (size_t i = 0; i < names.size(); i++)
 	{
-		if (*it1 == "clos_mask")
-		{
-			double val_clos = (double) acc::last(events.at(*it1));
-			std::string s_clos = double2hexstr(val_clos);
-			ss << s_clos;
-		}
-		else
-			ss << acc::last(events.at(*it1));
-
-		it1++;
-
-		if (it1 != names.cend())
+		if (i > 0)
 			ss << sep;
+
+		metric_t id = ids[i];
+		if (id == clos_mask)
+			ss << double2hexstr(v_last[id]);
+		else
+			ss << v_last[id];
 	}
 
 	// Derived metrics
-	for (auto it = derived_metrics_int.cbegin(); it != derived_metrics_int.cend(); it++)
-	{
-		double value = it->second();
-		ss << sep << value;
-	}
+	for (const auto &der : derived)
+		ss << sep << v_last[der.first];
 
 	return ss.str();
 }
 
 
-double Stats::get_current(const std::string &name) const
+double Stats::get_current(metric_t id) const
+{
+	int i = (id < counter_pos.size()) ? counter_pos[id] : -1;
+	if (i < 0 || ccurr.empty())
+		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(metric_name(id))));
+	if (ccurr.values[i] == 0) return 0; // This way we don't have to worry about enabled being 0
+	return ccurr.values[i] / ((double) ccurr.running[i] / (double) ccurr.enabled[i]);
+}
+
+
+double Stats::duration() const
+{
+	return std::chrono::duration<double>(tend - tstart).count();
+}
+
+
+double Stats::duration_total() const
 {
-	const auto &curr_index = ccurr.get<by_name>();
-	auto it = curr_index.find(name);
-	if (it == curr_index.end())
-		throw_with_trace(std::runtime_error("Event not monitorized '{}'"_format(name)));
-	if (it->value == 0) return 0; // This way we don't have to worry about enabled being 0
-	return it->value / ((double) it->running / (double) it->enabled);
+	return std::chrono::duration<double>(elapsed).count();
 }
 
 
-double Stats::sum(const std::string &name) const
+double Stats::rate(metric_t id) const
 {
-	return acc::sum(events.at(name));
+	double seconds = duration();
+	return seconds > 0 ? last(id) / seconds : NAN;
 }
 
 
-double Stats::last(const std::string &name) const
+double Stats::rate_total(metric_t id) const
 {
-	return acc::last(events.at(name));
+	double seconds = duration_total();
+	return seconds > 0 ? sum(id) / seconds : NAN;
 }
 
 
 void Stats::reset_counters()
 {
-	clast = counters_t();
-	ccurr = counters_t();
+	clast.clear();
+	ccurr.clear();
 }
@@ -18,34 +18,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <cstdint>
-#include <map>
+#include <functional>
 #include <ostream>
+#include <string>
+#include <vector>
 
-#include <boost/accumulators/accumulators.hpp>
-#include <boost/accumulators/statistics/rolling_mean.hpp>
-#include <boost/accumulators/statistics/rolling_window.hpp>
-#include <boost/accumulators/statistics/mean.hpp>
-#include <boost/accumulators/statistics/stats.hpp>
-#include <boost/accumulators/statistics/variance.hpp>
-
-#include "accum-last.hpp"
+#include "derived-metrics.hpp"
 #include "events-perf.hpp"
+#include "quantile-sketch.hpp"
+#include "sampling-clock.hpp"
+#include "time-series.hpp"
+
+
+// A metric_t is the handle of a metric (counter or derived metric). Names are resolved to handles once,
+// and handles are the same for the stats of every task, so they can be resolved before knowing the tasks.
 
 
 class Stats
 {
-	// Declare the 'accum_t' typedef
-	#define ACC boost::accumulators
-	typedef ACC::accumulator_set <
-		double,
-		ACC::stats <
-			ACC::tag::last,
-			ACC::tag::sum,
-			ACC::tag::mean,
-			ACC::tag::variance,
-			ACC::tag::rolling_mean>> accum_t;
-	#undef ACC
-
 	// Set to true when the 'init' method is called
 	bool initialized = false;
 
@@ -53,46 +43,126 @@ class Stats
 	uint64_t counter = 0;
 
 	// Last and current counter values that have been passed to the 'accum' method
-	counters_t cbak; // Only for the names and properties of the counters after a reset
-	counters_t clast;
-	counters_t ccurr;
-
-	// Vectors with lambdas that compute derived stats
-	std::vector<
-		std::pair<
-			std::string,
-			std::function<double()>
-		>
-	> derived_metrics_int, derived_metrics_total;
-
-	// Vector with the names of the counters that will be accumulated
-	std::vector<std::string> names;
+	CounterSnapshot clast;
+	CounterSnapshot ccurr;
+	counter_table_t table; // Only for the names and properties of the counters after a reset
 
-	std::string data_to_string(const std::string &sep, bool force_snapshot) const;
+	// Monotonic time span covered by the last sample and total time covered by all the samples
+	mono_time_t tstart;
+	mono_time_t tend;
+	std::chrono::nanoseconds elapsed = std::chrono::nanoseconds(0);
 
-	public:
+	// Derived metrics computed for this task, in order of evaluation. They are stored like the counters.
+	std::vector<std::pair<metric_t, Expression>> derived;
 
-	std::map<std::string, accum_t> events;
+	// Vector with the names of the counters that will be accumulated, and their handles
+	std::vector<std::string> names;
+	std::vector<metric_t> ids;
+	metric_t clos_mask;
+
+	// Accumulated values of every metric, as a structure of arrays indexed by handle
+	size_t width = 0; // Handles known when the stats were initialized
+	std::vector<bool> present;
+	std::vector<double> v_last;
+	std::vector<double> v_sum;
+	std::vector<double> v_mean;
+	std::vector<double> v_m2; // Sum of squared differences from the mean
+
+	// Last values of the metrics, with a column for each one of them, in the order of 'ids'
+	TimeSeries series;
+	std::vector<int> column_pos; // By handle
+	std::vector<double> row;
+
+	// Handle of every counter of the snapshots, by position, and the other way around
+	std::vector<metric_t> counter_ids;
+	std::vector<int> counter_pos;
+	std::vector<bool> counter_starts_at_zero; // Counters whose first value is not meaningful (i.e. energy)
+
+	// Quantiles of some metrics, over the whole run and over a sliding window
+	std::vector<metric_t> sketch_ids;
+	std::vector<int> sketch_pos; // By handle
+	std::vector<TDigest> sketch_run;
+	std::vector<WindowedTDigest> sketch_window;
+
+	void resolve(const CounterSnapshot &counters);
+	void push(metric_t id, double value);
+	void check(metric_t id) const;
+	void init_derived_metrics();
+	void init_quantiles();
+	size_t sketch(metric_t id) const;
+
+	public:
 
 	Stats() = default;
 	Stats(const std::vector<std::string> &counters);
 
+	// Handle of a metric, and its name
+	static metric_t metric(const std::string &name);
+	static std::string metric_name(metric_t id);
+
+	// Derived metrics declared by the user, computed after the built-in ones (ipc and ref-ipc).
+	// Must be called before initializing any stats.
+	static void define_derived_metrics(const std::vector<DerivedMetric> &metrics);
+
+	// Metrics whose quantiles are computed. Must be called before initializing any stats.
+	static void define_quantile_metrics(const QuantileMetrics &metrics);
+
 	void init(const std::vector<std::string> &counters);
-	void init_derived_metrics_total(const std::vector<std::string> &counters);
-	void init_derived_metrics_int(const std::vector<std::string> &counters);
-	Stats& accum(const counters_t &c);
+	// The sample contains the counter values at 'end', and the task has been running since 'start'.
+	// Counters are matched by position with the first snapshot, so no names are looked up.
+	Stats& accum(const CounterSnapshot &c, mono_time_t start, mono_time_t end);
 
 	void reset_counters();
 
-	double get_current(const std::string &name) const;
+	// The metric is a counter or a derived metric computed for this task
+	bool has(metric_t id) const { return id < width && present[id]; }
+
+	double get_current(metric_t id) const;
+	double get_current(const std::string &name) const { return get_current(metric(name)); }
 
 	// sum of accumulated values
-	double sum(const std::string &name) const;
+	double sum(metric_t id) const { check(id); return v_sum[id]; }
+	double sum(const std::string &name) const { return sum(metric(name)); }
 	// Last accumulated value into the counter
-	double last(const std::string &name) const;
+	double last(metric_t id) const { check(id); return v_last[id]; }
+	double last(const std::string &name) const { return last(metric(name)); }
+	// Mean and variance of all the values, and mean of the last ones
+	double mean(metric_t id) const { check(id); return v_mean[id]; }
+	double variance(metric_t id) const;
+	double rolling_mean(metric_t id) const;
+
+	// History of the metrics, at the resolutions of TimeSeries. The column of a metric does not change.
+	const TimeSeries& history() const { return series; }
+	size_t history_column(metric_t id) const { check(id); return column_pos[id]; }
+	double history_mean(metric_t id, size_t n, size_t level = 0) const { return series.mean(level, history_column(id), n); }
+	// Quantile q (i.e. 0.99) of all the values, and of the last ones. Only for the metrics with quantiles.
+	bool has_quantiles(metric_t id) const { return id < sketch_pos.size() && sketch_pos[id] >= 0; }
+	double quantile(metric_t id, double q) const;
+	double rolling_quantile(metric_t id, double q) const;
+
+	// End of the span covered by the last sample
+	mono_time_t last_time() const { return tend; }
+
+	// Seconds covered by the last sample and by all the samples
+	double duration() const;
+	double duration_total() const;
+
+	// Events per second in the last sample and during all the samples
+	double rate(metric_t id) const;
+	double rate(const std::string &name) const { return rate(metric(name)); }
+	double rate_total(metric_t id) const;
+	double rate_total(const std::string &name) const { return rate_total(metric(name)); }
+
+	// Columns of the interval output (counters followed by derived metrics), without formatting them
+	size_t num_columns() const { return ids.size(); }
+	std::vector<std::string> column_names() const;
+	void data_int(double *values) const;
 
 	std::string header_to_string(const std::string &sep) const;
 	std::string data_to_string_int(const std::string &sep) const;
 	std::string data_to_string_total(const std::string &sep) const;
+	// Quantiles of the whole run, printed after the totals
+	std::string quantiles_header_to_string(const std::string &sep) const;
+	std::string quantiles_to_string(const std::string &sep) const;
 	std::string double2hexstr(double x) const;
 };
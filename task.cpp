@@ -16,6 +16,7 @@
 #include <glib.h>
 
 #include "log.hpp"
+#include "sched.hpp"
 #include "task.hpp"
 #include "throw-with-trace.hpp"
 
@@ -181,6 +182,50 @@ void tasks_resume(const tasklist_t &tasklist)
 }
 
 
+// Detect the tasks that have finished when they are not being paused
+void tasks_check_exited(tasklist_t &tasklist)
+{
+	for (const auto &task : tasklist)
+	{
+		if (task->get_status() != Task::Status::runnable)
+			continue;
+
+		if (task_exited(*task))
+		{
+			LOGWAR("Task {}:{} with pid {} exited with status '0'"_format(task->id, task->name, task->pid));
+			task->completed++;
+			task->set_status(Task::Status::exited);
+		}
+	}
+}
+
+
+PauseMode pause_mode_from_str(const std::string &str)
+{
+	if (str == "signal")
+		return PauseMode::signal;
+	if (str == "none")
+		return PauseMode::none;
+	if (str == "freezer")
+		return PauseMode::freezer;
+	throw_with_trace(std::runtime_error("Unknown pause mode '{}', it should be 'signal', 'none' or 'freezer'"_format(str)));
+}
+
+
+const std::string pause_mode_to_str(PauseMode mode)
+{
+	switch (mode)
+	{
+		case PauseMode::signal:
+			return "signal";
+		case PauseMode::none:
+			return "none";
+		case PauseMode::freezer:
+			return "freezer";
+	}
+	throw_with_trace(std::runtime_error("Unknown pause mode, should not reach this"));
+}
+
 
 // Execute a task and immediately pause it
 void task_execute(Task &task)
@@ -201,6 +246,11 @@ void task_execute(Task &task)
 		{
 			setsid();
 
+			// The signal mask survives exec, and the manager may have blocked some signals
+			sigset_t mask;
+			sigemptyset(&mask);
+			sigprocmask(SIG_SETMASK, &mask, NULL);
+
 			// Set CPU affinity
 			try
 			{
@@ -349,12 +399,28 @@ void task_restart_or_set_done(Task &task, cat_ptr_t cat, Perf &perf, const std::
 	const auto status = task.get_status();
 	uint32_t clos = -1U; // Invalid value
 
+	// Attached tasks are not ours, just stop tracking them
+	if (task.attached)
+	{
+		if (status == Task::Status::limit_reached || status == Task::Status::exited)
+		{
+			LOGINF("Task {}:{} with pid {} is {}, detaching"_format(task.id, task.name, task.pid, task.status_to_str()));
+			perf.clean(task.pid);
+			if (cat_linux)
+				cat_linux->forget_task(task.pid);
+			task.set_status(Task::Status::done);
+		}
+		return;
+	}
+
 	if (cat_linux)
 		clos = cat_linux->get_clos_of_task(task.pid);
 
 	if (status == Task::Status::limit_reached || status == Task::Status::exited)
 	{
 		perf.clean(task.pid);
+		if (cat_linux)
+			cat_linux->forget_task(task.pid);
 		if (status == Task::Status::limit_reached)
 		{
 			LOGINF("Task {}:{} limit reached, killing"_format(task.id, task.name));
@@ -389,15 +455,38 @@ void task_restart_or_set_done(Task &task, cat_ptr_t cat, Perf &perf, const std::
 }
 
 
+void task_admit(Task &task, cat_ptr_t cat, Perf &perf, const std::vector<std::string> &events)
+{
+	// As with the initial tasks, CLOS mapping is only done when asked for
+	if (task.initial_clos)
+	{
+		auto cat_linux = std::dynamic_pointer_cast<CATLinux>(cat);
+		if (!cat_linux)
+			throw_with_trace(std::runtime_error("Invalid CAT pointer: Ensure that you are using the Linux CAT implementation"));
+		LOGINF("Map task {}:{} with PID {} to CLOS {}"_format(task.id, task.name, task.pid, task.initial_clos));
+		cat_linux->add_task(task.initial_clos, task.pid);
+	}
+
+	perf.setup_events(task.pid, events);
+}
+
+
+bool task_has_arrived(const Task &task, uint32_t interval, double elapsed_seconds)
+{
+	return interval >= task.start_interval && elapsed_seconds >= task.start_seconds;
+}
+
+
 void task_stats_print_interval(const Task &t, uint64_t interval, std::ostream &out, const std::string &sep)
 {
-	int cpu_id = get_cpu_id(t.pid);
+	static const metric_t instructions = Stats::metric("instructions");
+
 	out << interval << sep << std::setfill('0') << std::setw(2);
-	out << t.id << "_" << t.name << sep << cpu_id << sep;
+	out << t.id << "_" << t.name << sep << t.cpu << sep;
 
 	// out << (t.max_instr ? (double) t.stats.get_current("instructions") / (double) t.max_instr : 0) << sep;
 	double completed = t.max_instr ?
-			(double) t.stats.sum("instructions") / (double) t.max_instr :
+			(double) t.stats.sum(instructions) / (double) t.max_instr :
 			NAN;
 	out << completed << sep;
 	out << t.stats.data_to_string_int(sep);
@@ -407,21 +496,26 @@ void task_stats_print_interval(const Task &t, uint64_t interval, std::ostream &o
 
 void task_stats_print_total(const Task &t, uint64_t interval, std::ostream &out, const std::string &sep)
 {
+	static const metric_t instructions = Stats::metric("instructions");
+
 	int cpu_id = get_cpu_id(t.pid);
 	out << interval << sep << std::setfill('0') << std::setw(2);
 	out << t.id << "_" << t.name << sep << cpu_id << sep;
 	double completed = t.max_instr ?
-			(double) t.stats.sum("instructions") / (double) t.max_instr :
+			(double) t.stats.sum(instructions) / (double) t.max_instr :
 			NAN;
 	out << completed << sep;
 	out << t.stats.data_to_string_total(sep) << sep;
 	out << t.ipc_phase_count << sep;
 	out << t.clos_change_count;
+	const auto quantiles = t.stats.quantiles_to_string(sep);
+	if (!quantiles.empty())
+		out << sep << quantiles;
 	out << std::endl;
 }
 
 
-void task_stats_print_headers(const Task &t, std::ostream &out, const std::string &sep)
+void task_stats_print_headers(const Task &t, std::ostream &out, bool total, const std::string &sep)
 {
 	out << "interval" << sep;
 	out << "app" << sep;
@@ -430,6 +524,9 @@ void task_stats_print_headers(const Task &t, std::ostream &out, const std::strin
 	out << t.stats.header_to_string(sep) << sep;
 	out << "phase_changes" << sep;
 	out << "CLOS_changes";
+	const auto quantiles = total ? t.stats.quantiles_header_to_string(sep) : "";
+	if (!quantiles.empty())
+		out << sep << quantiles;
 	out << std::endl;
 }
 
@@ -462,8 +559,30 @@ void tasks_map_to_initial_clos(tasklist_t &tasklist, const std::shared_ptr<CATLi
 }
 
 
+// Attached tasks are not our children, so we cannot wait for them
+static
+bool attached_task_exited(const Task &task)
+{
+	if (kill(task.pid, 0) < 0 && errno == ESRCH)
+		return true;
+
+	// Exited but not reaped yet by its parent
+	try
+	{
+		return sched::Stat(task.pid).state == 'Z';
+	}
+	catch (const std::exception &e)
+	{
+		return true;
+	}
+}
+
+
 bool task_exited(const Task &task)
 {
+	if (task.attached)
+		return attached_task_exited(task);
+
 	int status = 0;
 	int ret = waitpid(task.pid, &status, WNOHANG);
 	switch (ret)
@@ -35,10 +35,15 @@ class Task
 	const uint64_t max_instr;      // Max number of instructions to execute
 	const uint32_t max_restarts;   // Maximum number of times this application is gonna be restarted after reaching the instruction limit or finishing
 	const bool batch;              // Batch tasks do not need to be completed in order to finish the execution
+	const bool attached = false;   // Already running process, not launched by us. It is never restarted or killed.
 
 	std::vector<uint32_t> cpus;    // Allowed cpus
+	uint32_t start_interval = 0;   // The task arrives at the start of this interval...
+	double start_seconds = 0;      // ...or once this many seconds have elapsed since the first interval
+	bool start_set = false;        // The arrival time has been given explicitly, even if it is 0
 	std::string rundir = ""; // Set before executing the task
 	pid_t pid = 0;           // Set after executing the task
+	int cpu = -1;            // CPU the task was in when its counters were last read
 
 	Stats stats = Stats();
 
@@ -58,6 +63,15 @@ class Task
 		max_instr(_max_instr), max_restarts(_max_restarts),
 		batch(_batch), cpus(_cpus) {}
 
+	// Attach to a process that is already running
+	Task(const std::string &_name, pid_t _pid, uint32_t _initial_clos,
+			const std::vector<uint32_t> &_cpus, uint64_t _max_instr, bool _batch) :
+		id(ID++), name(_name), cmd(""),
+		initial_clos(_initial_clos),
+		out(""), in(""), err(""), skel({}),
+		max_instr(_max_instr), max_restarts(0),
+		batch(_batch), attached(true), cpus(_cpus), pid(_pid) {}
+
 	static
 	const std::string status_to_str(const Status& s);
 
@@ -74,9 +88,21 @@ typedef std::shared_ptr<Task> task_ptr_t;
 typedef std::vector<task_ptr_t> tasklist_t;
 
 
+// How the tasks are stopped while the manager does its work at the end of each interval
+enum class PauseMode
+{
+	signal, // SIGSTOP/SIGCONT every interval
+	none,   // The tasks keep running and the counters are read on the fly
+	freezer, // The cgroup v2 freezer stops all the tasks and their descendants at once
+};
+PauseMode pause_mode_from_str(const std::string &str);
+const std::string pause_mode_to_str(PauseMode mode);
+
+
 void tasks_set_rundirs(tasklist_t &tasklist, const std::string &rundir_base);
 void tasks_pause(tasklist_t &tasklist);
 void tasks_resume(const tasklist_t &tasklist);
+void tasks_check_exited(tasklist_t &tasklist); // Without pausing them, status can change from runnable -> exited
 void tasks_map_to_initial_clos(tasklist_t &tasklist, const std::shared_ptr<CATLinux> &cat);
 std::vector<uint32_t> tasks_cores_used(const tasklist_t &tasklist);
 const task_ptr_t& tasks_find(const tasklist_t &tasklist, uint32_t id);
@@ -99,6 +125,11 @@ bool task_exited(const Task &task); // Test if the task has exited
 // If the limit of restarts has not been reached, restart the application. If the limit of restarts was reached, mark the application as done.
 void task_restart_or_set_done(Task &task, cat_ptr_t cat, Perf &perf, const std::vector<std::string> &events);
 
-void task_stats_print_headers(const Task &t, std::ostream &out, const std::string &sep = ",");
+// Map a task that joins the workload to its initial CLOS and start monitoring it
+void task_admit(Task &task, cat_ptr_t cat, Perf &perf, const std::vector<std::string> &events);
+bool task_has_arrived(const Task &task, uint32_t interval, double elapsed_seconds);
+
+// The quantiles of the metrics are only printed in the total stats
+void task_stats_print_headers(const Task &t, std::ostream &out, bool total, const std::string &sep = ",");
 void task_stats_print_interval(const Task &t, uint64_t interval, std::ostream &out, const std::string &sep = ",");
 void task_stats_print_total(const Task &t, uint64_t interval, std::ostream &out, const std::string &sep = ",");
@@ -0,0 +1,50 @@
+#include "throw-with-trace.hpp"
+#include "time-series.hpp"
+
+
+TimeSeries::TimeSeries(size_t _columns, size_t _capacity) : columns(_columns), capacity(_capacity)
+{
+	if (!capacity)
+		throw_with_trace(std::runtime_error("A time series must have room for at least one point"));
+	for (auto &l : levels)
+	{
+		l.data.assign(columns * capacity, 0);
+		l.partial.assign(columns, 0);
+	}
+}
+
+
+void TimeSeries::push(size_t level, const double *row)
+{
+	auto &l = levels[level];
+	size_t slot = l.count % capacity;
+	for (size_t c = 0; c < columns; c++)
+		l.data[c * capacity + slot] = row[c];
+	l.count++;
+
+	if (level + 1 == num_levels)
+		return;
+
+	// Downsample into the next level
+	auto &next = levels[level + 1];
+	for (size_t c = 0; c < columns; c++)
+		next.partial[c] += row[c];
+	if (++next.pending < factor)
+		return;
+	for (auto &v : next.partial)
+		v /= factor;
+	push(level + 1, next.partial.data());
+	std::fill(next.partial.begin(), next.partial.end(), 0);
+	next.pending = 0;
+}
+
+
+double TimeSeries::mean(size_t level, size_t column, size_t n) const
+{
+	n = std::min(n, size(level));
+	if (!n)
+		return 0;
+	double sum = 0;
+	scan(level, column, n, [&sum](double v) { sum += v; });
+	return sum / n;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+
+// Recent history of a fixed set of columns, at several resolutions. Level 0 keeps every sample, and
+// every other level keeps the means of 'factor' samples of the previous one (i.e. 1, 10 and 100 samples
+// per point). Each level is a ring of 'capacity' points, so appending is O(1) and memory is fixed.
+// The history of a column is contiguous in memory, to scan it quickly.
+class TimeSeries
+{
+	public:
+
+	static const size_t num_levels = 3;
+	static const size_t factor = 10;
+
+	private:
+
+	struct Level
+	{
+		std::vector<double> data;    // Column-major, 'capacity' points per column
+		std::vector<double> partial; // Sums of the samples of the previous level not averaged yet
+		size_t pending = 0;          // Number of samples in the partial sums
+		uint64_t count = 0;          // Points appended since the beginning
+	};
+
+	size_t columns = 0;
+	size_t capacity = 0;
+	std::array<Level, num_levels> levels;
+
+	void push(size_t level, const double *row);
+
+	public:
+
+	TimeSeries() = default;
+	TimeSeries(size_t _columns, size_t _capacity);
+
+	// Add a sample with a value for each column
+	void append(const double *row) { push(0, row); }
+
+	// Points stored in a level, and points appended to it since the beginning
+	size_t size(size_t level) const { return std::min<uint64_t>(levels[level].count, capacity); }
+	uint64_t count(size_t level) const { return levels[level].count; }
+
+	// Value of a column 'age' points ago, age 0 being the last one
+	double get(size_t level, size_t column, size_t age) const
+	{
+		const auto &l = levels[level];
+		assert(age < size(level));
+		return l.data[column * capacity + (l.count - 1 - age) % capacity];
+	}
+
+	// Call f(value) for the last n points of a column, from the newest to the oldest
+	template <typename F>
+	void scan(size_t level, size_t column, size_t n, F f) const
+	{
+		const auto &l = levels[level];
+		n = std::min(n, size(level));
+		if (!n)
+			return;
+
+		// The ring is traversed as two contiguous segments
+		const double *base = &l.data[column * capacity];
+		size_t newest = (l.count - 1) % capacity;
+		size_t first = std::min(n, newest + 1);
+		for (size_t i = 0; i < first; i++)
+			f(base[newest - i]);
+		for (size_t i = 0; i < n - first; i++)
+			f(base[capacity - 1 - i]);
+	}
+
+	// Mean of the last n points of a column, 0 if there are none
+	double mean(size_t level, size_t column, size_t n) const;
+};
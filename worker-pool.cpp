@@ -0,0 +1,134 @@
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "log.hpp"
+#include "throw-with-trace.hpp"
+#include "worker-pool.hpp"
+
+
+using fmt::literals::operator""_format;
+
+
+WorkerPool::WorkerPool(size_t width, const std::vector<uint32_t> &cpus)
+{
+	if (width == 0)
+		throw_with_trace(std::runtime_error("The worker pool needs at least one thread"));
+
+	for (size_t i = 1; i < width; i++)
+		threads.emplace_back(&WorkerPool::worker, this, i, cpus);
+}
+
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	cv_work.notify_all();
+	for (auto &t : threads)
+		t.join();
+}
+
+
+// Take iterations of the current job until there are no more left
+void WorkerPool::work()
+{
+	while (true)
+	{
+		size_t i;
+		const std::function<void(size_t)> *func;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (next >= job_size)
+				return;
+			i = next++;
+			func = job;
+		}
+
+		try
+		{
+			(*func)(i);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+				error = std::current_exception();
+		}
+	}
+}
+
+
+void WorkerPool::worker(size_t idx, const std::vector<uint32_t> &cpus)
+{
+	// Each helper is pinned to one of the cpus the manager is allowed to use
+	if (!cpus.empty())
+	{
+		try
+		{
+			set_cpu_affinity({cpus[idx % cpus.size()]});
+		}
+		catch (const std::exception &e)
+		{
+			LOGWAR("Could not pin worker {}: {}"_format(idx, e.what()));
+		}
+	}
+
+	uint64_t seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv_work.wait(lock, [this, seen]() { return stop || generation != seen; });
+			if (stop)
+				return;
+			seen = generation;
+		}
+
+		work();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--busy == 0)
+				cv_done.notify_one();
+		}
+	}
+}
+
+
+void WorkerPool::run(size_t n, const std::function<void(size_t)> &func)
+{
+	// Not worth waking anybody up
+	if (threads.empty() || n <= 1)
+	{
+		for (size_t i = 0; i < n; i++)
+			func(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &func;
+		job_size = n;
+		next = 0;
+		busy = threads.size();
+		error = nullptr;
+		generation++;
+	}
+	cv_work.notify_all();
+
+	work();
+
+	std::exception_ptr e;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv_done.wait(lock, [this]() { return busy == 0; });
+		job = nullptr;
+		job_size = 0;
+		std::swap(e, error);
+	}
+
+	if (e)
+		std::rethrow_exception(e);
+}
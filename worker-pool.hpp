@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed pool of threads used to run the iterations of a loop in parallel.
+// The calling thread also takes part in the work, so a pool of width 1 has no helper threads and
+// runs everything serially.
+class WorkerPool
+{
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable cv_work;
+	std::condition_variable cv_done;
+
+	// Current job, protected by the mutex
+	const std::function<void(size_t)> *job = nullptr;
+	size_t job_size = 0;
+	size_t next = 0;          // Next iteration to run
+	size_t busy = 0;          // Helper threads still working on the current job
+	uint64_t generation = 0;  // Incremented every time a new job is posted
+	bool stop = false;
+	std::exception_ptr error; // First exception thrown by the current job
+
+	void worker(size_t idx, const std::vector<uint32_t> &cpus);
+	void work();
+
+	public:
+
+	WorkerPool() = delete;
+	WorkerPool(size_t width, const std::vector<uint32_t> &cpus = {});
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	size_t width() const { return threads.size() + 1; }
+
+	// Call func(0) ... func(n - 1) using all the threads of the pool and wait for them to finish.
+	// If any of the calls throws, the first exception is rethrown here once all of them have finished.
+	void run(size_t n, const std::function<void(size_t)> &func);
+};